@@ -0,0 +1,97 @@
+#ifndef _ARENA_H__
+#define _ARENA_H__
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+using namespace std;
+
+/* Usage of the request arenas, summed over all connections */
+struct ArenaStats
+{
+    /* Requests that allocated from their arena */
+    size_t requests;
+    size_t allocations;
+    size_t bytes;
+    /* Blocks borrowed beyond the first of a request */
+    size_t extraBlocks;
+};
+
+/*
+* Bump-pointer scratch memory of one request. Allocating moves a pointer through blocks borrowed
+* from the buffer pool and freeing is a no-op; reset() hands the blocks back at once when the request
+* is answered, so a request that fit in its first block is reset in constant time. Memory is only
+* borrowed by requests that allocate. Not thread safe: a request is handled by one thread at a time.
+*/
+class Arena
+{
+public:
+    /* Size of a block, allocations larger than half of it get a block of their own */
+    static constexpr size_t BLOCK_SIZE = 4096;
+
+    Arena();
+    ~Arena();
+    /* size bytes aligned to align, a power of two */
+    void* allocate(size_t size, size_t align = alignof(max_align_t));
+    /* Copy of len bytes of text, NUL-terminated */
+    char* copy(const char* text, size_t len);
+    /* Release everything allocated since the last reset */
+    void reset();
+    /* Allocations and bytes since the last reset */
+    size_t allocations() const { return m_allocations; }
+    size_t bytes() const { return m_bytes; }
+    /* Usage of all arenas */
+    static ArenaStats stats();
+
+private:
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    /* Borrow a block of at least size usable bytes and make it current */
+    void grow(size_t size);
+
+private:
+    /* Header at the start of each block, blocks are chained newest first */
+    struct Block
+    {
+        Block* next;
+        size_t size;
+    };
+    Block* m_blocks;
+    /* Free space of the current block */
+    char* m_cur;
+    char* m_end;
+    size_t m_allocations;
+    size_t m_bytes;
+    size_t m_blockCount;
+    static atomic<size_t> m_totalRequests;
+    static atomic<size_t> m_totalAllocations;
+    static atomic<size_t> m_totalBytes;
+    static atomic<size_t> m_totalExtraBlocks;
+};
+
+/* Allocator adapter so standard containers can live in an arena; deallocation is a no-op */
+template<typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(Arena& arena): m_arena(&arena) {}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other): m_arena(other.m_arena) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(m_arena->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T*, size_t) {}
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return m_arena == other.m_arena; }
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return m_arena != other.m_arena; }
+
+private:
+    template<typename U>
+    friend class ArenaAllocator;
+    Arena* m_arena;
+};
+
+#endif
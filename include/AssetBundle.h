@@ -0,0 +1,152 @@
+#ifndef _ASSET_BUNDLE_H__
+#define _ASSET_BUNDLE_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include "CompressCache.h"
+using namespace std;
+
+/* Magic number at the start of an asset bundle ("WSASSETB") */
+static constexpr uint64_t ASSET_BUNDLE_MAGIC = 0x4254455353415357ULL;
+static constexpr uint32_t ASSET_BUNDLE_VERSION = 1;
+
+/*
+* File layout, every offset counts from the start of the file:
+*   BundleHeader | BundleEntry[count] sorted by path | uint32_t slots[slotCount] | strings | blobs
+* The slots are an open-addressing hash index over the entries, 0 marks a free slot and i + 1 entry i.
+* The strings are the paths, the header lines and the ETags. Blobs start on BUNDLE_ALIGN boundaries.
+*/
+struct BundleHeader
+{
+    /* Always ASSET_BUNDLE_MAGIC */
+    uint64_t magic;
+    /* Layout version */
+    uint32_t version;
+    /* Number of entries */
+    uint32_t count;
+    /* Number of hash slots, a power of two */
+    uint32_t slotCount;
+    uint32_t reserved;
+    uint64_t entriesOffset;
+    uint64_t slotsOffset;
+    /* Size of the whole file, a truncated bundle is refused */
+    uint64_t size;
+};
+
+/* One content coding of an asset, length 0 when the coding is not stored */
+struct BundleVariant
+{
+    uint64_t offset;
+    uint64_t length;
+    /* Precomputed header lines: Content-Length, ETag, and Content-Encoding and Vary where they apply */
+    uint64_t headOffset;
+    uint64_t etagOffset;
+    uint32_t headLen;
+    uint32_t etagLen;
+};
+
+struct BundleEntry
+{
+    /* Hash of the path, see AssetBundle::hashPath() */
+    uint64_t hash;
+    /* URL path, "/index.html" */
+    uint64_t pathOffset;
+    uint32_t pathLen;
+    /* Compressed variants are stored, so responses vary on Accept-Encoding */
+    uint32_t vary;
+    /* Indexed by ContentEncoding */
+    BundleVariant variants[3];
+};
+
+/*
+* A document root packed into one read-only file and mapped whole. A request is answered with one
+* hash lookup and no stat, open or mmap; the body is a slice of the mapping and the header lines are
+* precomputed. A bundle is immutable, it is replaced by loading a new file, and responses still being
+* sent keep the old one alive through the shared pointer.
+*/
+class AssetBundle
+{
+public:
+    /* Blob alignment, a cache line */
+    static constexpr size_t BUNDLE_ALIGN = 64;
+    /* Larger files are left out, they are streamed from the filesystem */
+    static constexpr off_t MAX_FILE_SIZE = 16 * 1024 * 1024;
+
+    ~AssetBundle();
+    /* Map and check the bundle at path, null if it is missing or malformed. warm faults every page in */
+    static shared_ptr<AssetBundle> load(const char* path, bool warm);
+    /* Pack the readable files under root into a bundle at path, with gzip and brotli variants of text files.
+       The bundle is written beside path and renamed over it, so a server never loads a partial file.
+       Returns the number of files packed, -1 on failure */
+    static int pack(const char* root, const char* path);
+    /* FNV-1a of the path */
+    static uint64_t hashPath(const char* path, size_t len);
+
+    /* Entry of a URL path, null if the bundle does not hold it */
+    const BundleEntry* find(const char* path, size_t len) const;
+    const char* data(uint64_t offset) const { return m_base + offset; }
+    size_t size() const { return m_size; }
+    uint32_t count() const { return m_header->count; }
+    /* Identity of the loaded file, a different one at the same path is a new bundle */
+    bool sameFile(const struct stat& st) const;
+
+private:
+    AssetBundle();
+    AssetBundle(const AssetBundle&) = delete;
+    AssetBundle& operator=(const AssetBundle&) = delete;
+    /* Offsets and lengths of the header and every entry lie inside the file */
+    bool check() const;
+
+private:
+    char* m_base;
+    size_t m_size;
+    const BundleHeader* m_header;
+    const BundleEntry* m_entries;
+    const uint32_t* m_slots;
+    struct stat m_stat;
+};
+
+/*
+* Singleton holding the bundle being served. Connections take a reference per request; the event loop
+* swaps in a new bundle when the file at the configured path is replaced, the usual deployment being
+* to pack into a new file and rename it over the old one.
+*/
+class AssetStore
+{
+public:
+    /* Get the globally unique instance */
+    static AssetStore* getInstance();
+    /* Serve the bundle at path, packing root into it first if it does not exist */
+    bool init(const char* path, const char* root);
+    /* Bundle to answer from, null when none is loaded */
+    shared_ptr<const AssetBundle> current();
+    /* Called by the event loop: swap in a replacement the helper thread has loaded, true if one was, and start
+       loading the file at the configured path on a helper thread if it is not the bundle being served */
+    bool refresh();
+
+private:
+    AssetStore(): m_loading(false), m_candidate(), m_rejected() {}
+    AssetStore(const AssetStore&) = delete;
+    AssetStore& operator=(const AssetStore&) = delete;
+    /* Load and warm the candidate, run on a helper thread */
+    static void* loadThread(void* arg);
+
+private:
+    string m_path;
+    /* Read and replaced with atomic_load and atomic_store */
+    shared_ptr<const AssetBundle> m_current;
+    /* Replacement loaded and warmed by the helper thread, waiting for the event loop to swap it in */
+    shared_ptr<const AssetBundle> m_loaded;
+    /* A helper thread is loading; the two files below are only touched by whoever holds this */
+    atomic<bool> m_loading;
+    /* File being loaded */
+    struct stat m_candidate;
+    /* Last file found malformed, not tried again until it changes */
+    struct stat m_rejected;
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef _BUFFER_POOL_H__
+#define _BUFFER_POOL_H__
+
+#include <cstddef>
+#include <vector>
+#include "Locker.h"
+using namespace std;
+
+/* Usage of the buffer pool, summed over all size classes */
+struct BufferPoolStats
+{
+    /* Bytes currently lent out */
+    size_t bytesInUse;
+    /* Bytes held by the pool, lent out or cached */
+    size_t bytesTotal;
+    /* Highest bytesInUse seen by stats() so far */
+    size_t bytesPeak;
+    /* Buffers currently lent out */
+    int buffersInUse;
+};
+
+/*
+* Singleton pool of I/O buffers shared by all connections, in power-of-two size classes from 1 KB to 64 KB.
+* Connections borrow buffers only while a request is in flight, so memory follows active requests
+* instead of open sockets. Each size class is a free list over slabs guarded by its own lock.
+* Requests above MAX_BUFFER_SIZE are rare (large request bodies) and are served by the heap, uncounted.
+*/
+class BufferPool
+{
+public:
+    /* Smallest and largest size class, as powers of two */
+    static constexpr int MIN_SHIFT = 10;
+    static constexpr int MAX_SHIFT = 16;
+    static constexpr int CLASS_NUM = MAX_SHIFT - MIN_SHIFT + 1;
+    /* Largest buffer the pool caches, bigger ones come straight from the heap */
+    static constexpr size_t MAX_BUFFER_SIZE = (size_t)1 << MAX_SHIFT;
+
+    /* Get the globally unique instance */
+    static BufferPool* getInstance();
+    /* Borrow a buffer of at least size bytes, size is updated to the real capacity */
+    char* acquire(size_t& size);
+    /* Return a buffer, size must be the capacity acquire() reported */
+    void release(char* buf, size_t size);
+    /* Current usage */
+    BufferPoolStats stats();
+
+private:
+    BufferPool();
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+    /* Index of the smallest class holding size bytes, -1 if none does */
+    static int classOf(size_t size);
+
+private:
+    /* A free buffer stores the link to the next free buffer in its first bytes */
+    struct FreeBuffer
+    {
+        FreeBuffer* next;
+    };
+    struct SizeClass
+    {
+        Locker lock;
+        FreeBuffer* freeList;
+        /* Slabs the buffers of this class are carved from */
+        vector<char*> slabs;
+        int total;
+        int inUse;
+    };
+    SizeClass m_classes[CLASS_NUM];
+    /* Protects m_bytesPeak */
+    Locker m_statLock;
+    size_t m_bytesPeak;
+};
+
+#endif
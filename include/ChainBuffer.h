@@ -0,0 +1,55 @@
+#ifndef _CHAIN_BUFFER_H__
+#define _CHAIN_BUFFER_H__
+
+#include <cstdarg>
+#include <vector>
+#include <sys/uio.h>
+#include "BufferPool.h"
+using namespace std;
+
+/*
+* Output buffer made of chunks borrowed from the buffer pool. A full chunk is followed by a new one
+* instead of being copied into a bigger one, so bytes never move and their offsets stay valid until clear().
+* The common case, a response head that fits the first chunk, costs a single pool acquire.
+*/
+class ChainBuffer
+{
+public:
+    explicit ChainBuffer(size_t chunkSize);
+    ~ChainBuffer();
+
+    /* Append len bytes */
+    void append(const char* data, size_t len);
+    /* Append printf-style text, returns the NUL-terminated text as it was stored */
+    const char* appendf(const char* format, va_list args);
+    /* Contiguous room for len bytes at the end, e.g. to read into; nothing is appended until commit() */
+    char* prepare(size_t len);
+    /* Append the first len bytes written into the room returned by prepare() */
+    void commit(size_t len);
+    /* Bytes appended since the last clear() */
+    size_t size() const { return m_size; }
+    /* Add iovec entries covering the bytes [offset, offset + len), adjacent memory is merged into the last entry */
+    void fill(size_t offset, size_t len, vector<iovec>& iov) const;
+    /* Give all chunks back to the pool */
+    void clear();
+
+private:
+    ChainBuffer(const ChainBuffer&) = delete;
+    ChainBuffer& operator=(const ChainBuffer&) = delete;
+    struct Chunk
+    {
+        char* data;
+        size_t capacity;
+        size_t used;
+    };
+    /* Last chunk, replaced by a new one when it has less than len bytes free */
+    Chunk& tail(size_t len);
+
+private:
+    /* Capacity asked from the pool for each new chunk */
+    size_t m_chunkSize;
+    vector<Chunk> m_chunks;
+    size_t m_size;
+};
+
+#endif
@@ -0,0 +1,598 @@
+#ifndef _CHANNEL_H__
+#define _CHANNEL_H__
+
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/* Padding between indexes written by different threads, so they never share a cache line */
+static constexpr size_t CHANNEL_CACHE_LINE = 64;
+
+/*
+* Event count on a futex word. A waiter samples the epoch, re-checks its condition and only sleeps
+* if nothing was published in between. Notifying costs a single load while nobody is waiting.
+*/
+class EventCount
+{
+public:
+    EventCount(): m_epoch(0), m_waiters(0) {}
+
+    /* Announce an upcoming wait and return the epoch to sleep on */
+    uint32_t prepareWait()
+    {
+        m_waiters.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return m_epoch.load(std::memory_order_acquire);
+    }
+    /* The condition became true after prepareWait(), do not sleep */
+    void cancelWait()
+    {
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+    /* Sleep until notified or until msTimeout expires, -1 waits forever */
+    void wait(uint32_t epoch, int msTimeout)
+    {
+        struct timespec t = { msTimeout / 1000, (msTimeout % 1000) * 1000000L };
+        syscall(SYS_futex, &m_epoch, FUTEX_WAIT_PRIVATE, epoch, msTimeout < 0 ? nullptr : &t, nullptr, 0);
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+    /* Wake up to n sleepers */
+    void notify(int n)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiters.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+        m_epoch.fetch_add(1, std::memory_order_release);
+        syscall(SYS_futex, &m_epoch, FUTEX_WAKE_PRIVATE, n, nullptr, nullptr, 0);
+    }
+
+private:
+    /* Futex word, bumped by every notify that may have a sleeper */
+    std::atomic<uint32_t> m_epoch;
+    /* Number of threads between prepareWait() and the end of wait() */
+    std::atomic<int> m_waiters;
+};
+
+/* Blocking, timeout and close handling shared by the channel variants */
+class ChannelSync
+{
+public:
+    /* Refuse further pushes and wake every waiter, queued items can still be popped */
+    void close()
+    {
+        m_closed.store(true, std::memory_order_seq_cst);
+        m_notEmpty.notify(INT_MAX);
+        m_notFull.notify(INT_MAX);
+    }
+    bool isClosed() const
+    {
+        return m_closed.load(std::memory_order_acquire);
+    }
+
+protected:
+    ChannelSync(): m_closed(false) {}
+
+    /* Retry op until it succeeds, the channel is closed or msTimeout expires (-1 waits forever, 0 never waits) */
+    template<typename F>
+    bool waitUntil(EventCount& event, F op, int msTimeout)
+    {
+        if (op()) {
+            return true;
+        }
+        struct timespec deadline = { 0, 0 };
+        if (msTimeout > 0) {
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += msTimeout / 1000;
+            deadline.tv_nsec += (msTimeout % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+        }
+        while (msTimeout != 0) {
+            uint32_t epoch = event.prepareWait();
+            if (op()) {
+                event.cancelWait();
+                return true;
+            }
+            if (isClosed()) {
+                event.cancelWait();
+                return false;
+            }
+            int remaining = -1;
+            if (msTimeout > 0) {
+                struct timespec now = { 0, 0 };
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                long long left = (deadline.tv_sec - now.tv_sec) * 1000LL + (deadline.tv_nsec - now.tv_nsec) / 1000000L;
+                if (left <= 0) {
+                    event.cancelWait();
+                    return false;
+                }
+                remaining = (int)left;
+            }
+            event.wait(epoch, remaining);
+            if (op()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+protected:
+    /* Signalled after every push */
+    EventCount m_notEmpty;
+    /* Signalled after every pop */
+    EventCount m_notFull;
+    /* Set by close() */
+    std::atomic<bool> m_closed;
+};
+
+/* Round a capacity up to a power of two so indexes wrap with a mask */
+inline size_t channelCapacity(size_t maxSize)
+{
+    if (maxSize == 0) {
+        throw std::exception();
+    }
+    size_t cap = 1;
+    while (cap < maxSize) {
+        cap <<= 1;
+    }
+    return cap;
+}
+
+/*
+* Bounded lock-free single-producer single-consumer channel.
+* Each side owns one index and keeps a cached copy of the other, so the fast path touches no shared line.
+*/
+template<typename T>
+class SpscChannel : public ChannelSync
+{
+public:
+    explicit SpscChannel(size_t maxSize = 1024);
+    ~SpscChannel();
+
+    /* Add an element if there is room, item is only moved from on success */
+    bool tryPush(T&& item);
+    bool tryPush(const T& item);
+    /* Add an element, waiting up to msTimeout for room */
+    bool push(T&& item, int msTimeout = -1);
+    bool push(const T& item, int msTimeout = -1);
+    /* Move up to n elements in, return how many fit */
+    size_t push_n(T* items, size_t n);
+    /* Take the first element if there is one */
+    bool tryPop(T& item);
+    /* Take the first element, waiting up to msTimeout, fails once closed and drained */
+    bool pop(T& item, int msTimeout = -1);
+    /* Wait up to msTimeout for at least one element, then take up to n of them */
+    size_t pop_n(T* items, size_t n, int msTimeout = -1);
+
+    /* Approximate while other threads are active */
+    size_t size() const;
+    bool isEmpty() const;
+    bool isFull() const;
+    size_t maxSize() const { return m_capacity; }
+
+private:
+    SpscChannel(const SpscChannel&) = delete;
+    SpscChannel& operator=(const SpscChannel&) = delete;
+    typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Slot;
+    T* slot(size_t pos) { return reinterpret_cast<T*>(&m_slots[pos & m_mask]); }
+    template<typename U> bool emplace(U&& item);
+    size_t popSome(T* items, size_t n);
+
+private:
+    size_t m_capacity;
+    size_t m_mask;
+    Slot* m_slots;
+    char m_pad0[CHANNEL_CACHE_LINE];
+    /* Consumer side: next position to pop and the last tail it saw */
+    std::atomic<size_t> m_head;
+    size_t m_cachedTail;
+    char m_pad1[CHANNEL_CACHE_LINE];
+    /* Producer side: next position to push and the last head it saw */
+    std::atomic<size_t> m_tail;
+    size_t m_cachedHead;
+    char m_pad2[CHANNEL_CACHE_LINE];
+};
+
+template<typename T>
+SpscChannel<T>::SpscChannel(size_t maxSize)
+: m_capacity(channelCapacity(maxSize)), m_mask(m_capacity - 1), m_slots(new Slot[m_capacity]),
+  m_head(0), m_cachedTail(0), m_tail(0), m_cachedHead(0)
+{
+}
+
+template<typename T>
+SpscChannel<T>::~SpscChannel()
+{
+    for (size_t pos = m_head.load(); pos != m_tail.load(); ++pos) {
+        slot(pos)->~T();
+    }
+    delete [] m_slots;
+}
+
+template<typename T>
+template<typename U>
+bool SpscChannel<T>::emplace(U&& item)
+{
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_cachedHead >= m_capacity) {
+        m_cachedHead = m_head.load(std::memory_order_acquire);
+        if (tail - m_cachedHead >= m_capacity) {
+            return false;
+        }
+    }
+    new (slot(tail)) T(std::forward<U>(item));
+    m_tail.store(tail + 1, std::memory_order_release);
+    m_notEmpty.notify(1);
+    return true;
+}
+
+template<typename T>
+bool SpscChannel<T>::tryPush(T&& item)
+{
+    return !isClosed() && emplace(std::move(item));
+}
+
+template<typename T>
+bool SpscChannel<T>::tryPush(const T& item)
+{
+    return !isClosed() && emplace(item);
+}
+
+template<typename T>
+bool SpscChannel<T>::push(T&& item, int msTimeout)
+{
+    return !isClosed() && waitUntil(m_notFull, [&]() { return emplace(std::move(item)); }, msTimeout);
+}
+
+template<typename T>
+bool SpscChannel<T>::push(const T& item, int msTimeout)
+{
+    return !isClosed() && waitUntil(m_notFull, [&]() { return emplace(item); }, msTimeout);
+}
+
+template<typename T>
+size_t SpscChannel<T>::push_n(T* items, size_t n)
+{
+    if (isClosed()) {
+        return 0;
+    }
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    if (m_capacity - (tail - m_cachedHead) < n) {
+        m_cachedHead = m_head.load(std::memory_order_acquire);
+    }
+    size_t room = m_capacity - (tail - m_cachedHead);
+    size_t count = n < room ? n : room;
+    for (size_t i = 0; i < count; ++i) {
+        new (slot(tail + i)) T(std::move(items[i]));
+    }
+    if (count > 0) {
+        /* One release store publishes the whole batch */
+        m_tail.store(tail + count, std::memory_order_release);
+        m_notEmpty.notify(1);
+    }
+    return count;
+}
+
+template<typename T>
+size_t SpscChannel<T>::popSome(T* items, size_t n)
+{
+    size_t head = m_head.load(std::memory_order_relaxed);
+    if (m_cachedTail - head < n) {
+        m_cachedTail = m_tail.load(std::memory_order_acquire);
+    }
+    size_t avail = m_cachedTail - head;
+    size_t count = n < avail ? n : avail;
+    for (size_t i = 0; i < count; ++i) {
+        T* p = slot(head + i);
+        items[i] = std::move(*p);
+        p->~T();
+    }
+    if (count > 0) {
+        m_head.store(head + count, std::memory_order_release);
+        m_notFull.notify(1);
+    }
+    return count;
+}
+
+template<typename T>
+bool SpscChannel<T>::tryPop(T& item)
+{
+    return popSome(&item, 1) == 1;
+}
+
+template<typename T>
+bool SpscChannel<T>::pop(T& item, int msTimeout)
+{
+    return waitUntil(m_notEmpty, [&]() { return popSome(&item, 1) == 1; }, msTimeout);
+}
+
+template<typename T>
+size_t SpscChannel<T>::pop_n(T* items, size_t n, int msTimeout)
+{
+    size_t count = 0;
+    waitUntil(m_notEmpty, [&]() { return (count = popSome(items, n)) > 0; }, msTimeout);
+    return count;
+}
+
+template<typename T>
+size_t SpscChannel<T>::size() const
+{
+    size_t head = m_head.load(std::memory_order_acquire);
+    size_t tail = m_tail.load(std::memory_order_acquire);
+    return tail >= head ? tail - head : 0;
+}
+
+template<typename T>
+bool SpscChannel<T>::isEmpty() const
+{
+    return size() == 0;
+}
+
+template<typename T>
+bool SpscChannel<T>::isFull() const
+{
+    return size() >= m_capacity;
+}
+
+/*
+* Bounded lock-free multi-producer multi-consumer channel (Vyukov's per-cell sequence queue).
+* Producers claim a cell with one CAS on the tail and consumers claim one with a CAS on the head,
+* so the thread pool and the file I/O pool share one channel between all their threads.
+*/
+template<typename T>
+class MpmcChannel : public ChannelSync
+{
+public:
+    explicit MpmcChannel(size_t maxSize = 1024);
+    ~MpmcChannel();
+
+    /* Add an element if there is room, item is only moved from on success */
+    bool tryPush(T&& item);
+    bool tryPush(const T& item);
+    /* Add an element, waiting up to msTimeout for room */
+    bool push(T&& item, int msTimeout = -1);
+    bool push(const T& item, int msTimeout = -1);
+    /* Move up to n elements in with a single wakeup, return how many fit */
+    size_t push_n(T* items, size_t n);
+    /* Take the first element if there is one */
+    bool tryPop(T& item);
+    /* Take the first element, waiting up to msTimeout, fails once closed and drained */
+    bool pop(T& item, int msTimeout = -1);
+    /* Wait up to msTimeout for at least one element, then take up to n of them */
+    size_t pop_n(T* items, size_t n, int msTimeout = -1);
+
+    /* Approximate while other threads are active */
+    size_t size() const;
+    bool isEmpty() const;
+    bool isFull() const;
+    size_t maxSize() const { return m_capacity; }
+
+private:
+    MpmcChannel(const MpmcChannel&) = delete;
+    MpmcChannel& operator=(const MpmcChannel&) = delete;
+    struct Cell
+    {
+        /* Equals the position when free for it, position + 1 once filled */
+        std::atomic<size_t> sequence;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type data;
+    };
+    T* value(Cell* cell) { return reinterpret_cast<T*>(&cell->data); }
+    template<typename U> bool emplace(U&& item);
+    bool take(T& item);
+
+private:
+    size_t m_capacity;
+    size_t m_mask;
+    Cell* m_cells;
+    char m_pad0[CHANNEL_CACHE_LINE];
+    /* Next position to pop */
+    std::atomic<size_t> m_head;
+    char m_pad1[CHANNEL_CACHE_LINE];
+    /* Next position to push */
+    std::atomic<size_t> m_tail;
+    char m_pad2[CHANNEL_CACHE_LINE];
+};
+
+template<typename T>
+MpmcChannel<T>::MpmcChannel(size_t maxSize)
+: m_capacity(channelCapacity(maxSize)), m_mask(m_capacity - 1), m_cells(new Cell[m_capacity]),
+  m_head(0), m_tail(0)
+{
+    for (size_t i = 0; i < m_capacity; ++i) {
+        m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+template<typename T>
+MpmcChannel<T>::~MpmcChannel()
+{
+    for (size_t pos = m_head.load(); pos != m_tail.load(); ++pos) {
+        Cell* cell = &m_cells[pos & m_mask];
+        if (cell->sequence.load() == pos + 1) {
+            value(cell)->~T();
+        }
+    }
+    delete [] m_cells;
+}
+
+template<typename T>
+template<typename U>
+bool MpmcChannel<T>::emplace(U&& item)
+{
+    size_t pos = m_tail.load(std::memory_order_relaxed);
+    Cell* cell = nullptr;
+    while (true) {
+        cell = &m_cells[pos & m_mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            /* The cell still holds the element from the previous lap: full */
+            return false;
+        }
+        else {
+            pos = m_tail.load(std::memory_order_relaxed);
+        }
+    }
+    new (value(cell)) T(std::forward<U>(item));
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+bool MpmcChannel<T>::take(T& item)
+{
+    size_t pos = m_head.load(std::memory_order_relaxed);
+    Cell* cell = nullptr;
+    while (true) {
+        cell = &m_cells[pos & m_mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            /* Not filled yet: empty */
+            return false;
+        }
+        else {
+            pos = m_head.load(std::memory_order_relaxed);
+        }
+    }
+    T* p = value(cell);
+    item = std::move(*p);
+    p->~T();
+    /* Hand the cell to the producer of the next lap */
+    cell->sequence.store(pos + m_capacity, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+bool MpmcChannel<T>::tryPush(T&& item)
+{
+    if (isClosed() || !emplace(std::move(item))) {
+        return false;
+    }
+    m_notEmpty.notify(1);
+    return true;
+}
+
+template<typename T>
+bool MpmcChannel<T>::tryPush(const T& item)
+{
+    if (isClosed() || !emplace(item)) {
+        return false;
+    }
+    m_notEmpty.notify(1);
+    return true;
+}
+
+template<typename T>
+bool MpmcChannel<T>::push(T&& item, int msTimeout)
+{
+    if (isClosed() || !waitUntil(m_notFull, [&]() { return emplace(std::move(item)); }, msTimeout)) {
+        return false;
+    }
+    m_notEmpty.notify(1);
+    return true;
+}
+
+template<typename T>
+bool MpmcChannel<T>::push(const T& item, int msTimeout)
+{
+    if (isClosed() || !waitUntil(m_notFull, [&]() { return emplace(item); }, msTimeout)) {
+        return false;
+    }
+    m_notEmpty.notify(1);
+    return true;
+}
+
+template<typename T>
+size_t MpmcChannel<T>::push_n(T* items, size_t n)
+{
+    if (isClosed()) {
+        return 0;
+    }
+    size_t count = 0;
+    while (count < n && emplace(std::move(items[count]))) {
+        count++;
+    }
+    if (count > 0) {
+        m_notEmpty.notify((int)count);
+    }
+    return count;
+}
+
+template<typename T>
+bool MpmcChannel<T>::tryPop(T& item)
+{
+    if (!take(item)) {
+        return false;
+    }
+    m_notFull.notify(1);
+    return true;
+}
+
+template<typename T>
+bool MpmcChannel<T>::pop(T& item, int msTimeout)
+{
+    if (!waitUntil(m_notEmpty, [&]() { return take(item); }, msTimeout)) {
+        return false;
+    }
+    m_notFull.notify(1);
+    return true;
+}
+
+template<typename T>
+size_t MpmcChannel<T>::pop_n(T* items, size_t n, int msTimeout)
+{
+    if (n == 0 || !waitUntil(m_notEmpty, [&]() { return take(items[0]); }, msTimeout)) {
+        return 0;
+    }
+    size_t count = 1;
+    while (count < n && take(items[count])) {
+        count++;
+    }
+    m_notFull.notify((int)count);
+    return count;
+}
+
+template<typename T>
+size_t MpmcChannel<T>::size() const
+{
+    size_t head = m_head.load(std::memory_order_acquire);
+    size_t tail = m_tail.load(std::memory_order_acquire);
+    return tail >= head ? tail - head : 0;
+}
+
+template<typename T>
+bool MpmcChannel<T>::isEmpty() const
+{
+    return size() == 0;
+}
+
+template<typename T>
+bool MpmcChannel<T>::isFull() const
+{
+    return size() >= m_capacity;
+}
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef _COMPRESS_CACHE_H__
+#define _COMPRESS_CACHE_H__
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <sys/stat.h>
+#include "Locker.h"
+using namespace std;
+
+/* Content codings the server produces, as bits of an Accept-Encoding mask */
+enum ContentEncoding { ENCODING_IDENTITY = 0, ENCODING_GZIP = 1, ENCODING_BROTLI = 2 };
+
+/* Usage of the compressed-variant cache */
+struct CompressCacheStats
+{
+    size_t entries;
+    size_t bytes;
+    size_t hits;
+    size_t misses;
+};
+
+/*
+* Singleton cache of compressed files, keyed by (path, encoding) and valid while the file keeps the
+* mtime and size it was compressed with. A miss reads and compresses the file on the calling thread,
+* which is a file I/O thread, so every text file is compressed once per change instead of per request.
+* Only one thread compresses a variant at a time, the others answer without it meanwhile. Compression
+* at request time uses moderate settings; the densest ones are left to bundles and prebuilt siblings.
+* The least recently used variants are dropped beyond the byte limit; a body still being sent keeps
+* its variant alive through the shared pointer.
+*/
+class CompressCache
+{
+public:
+    /* Files up to this size are compressed on the fly, larger ones only served from prebuilt siblings */
+    static constexpr off_t MAX_FILE_SIZE = 4 * 1024 * 1024;
+    /* Smaller files do not gain enough to pay for the Content-Encoding header */
+    static constexpr off_t MIN_FILE_SIZE = 256;
+    /* Brotli quality and gzip level of compression at request time, many times faster than the densest ones */
+    static constexpr int REQUEST_BROTLI_QUALITY = 5;
+    static constexpr int REQUEST_GZIP_LEVEL = 6;
+
+    /* Get the globally unique instance */
+    static CompressCache* getInstance();
+    /* Bytes of compressed variants kept, 0 disables the cache and on-the-fly compression */
+    void init(size_t maxBytes);
+    /* Compressed body of the file described by st, null if it cannot be compressed, does not shrink, or
+       another thread is compressing it right now */
+    shared_ptr<const string> get(const char* path, const struct stat& st, ContentEncoding encoding);
+    /* Current usage */
+    CompressCacheStats stats();
+
+    /* Compress in with the given encoding, the codings used for responses; dense picks the slowest and
+       densest settings, for output that is built once ahead of time */
+    static bool compress(const string& in, ContentEncoding encoding, string& out, bool dense);
+    /* Text formats worth compressing, everything else (images, audio, video, archives) is compressed already */
+    static bool isCompressible(const char* path);
+    /* Token of the encoding in Content-Encoding, and the suffix of a prebuilt sibling */
+    static const char* encodingName(ContentEncoding encoding);
+    static const char* encodingSuffix(ContentEncoding encoding);
+    /* Read the first size bytes of a file */
+    static bool readFile(const char* path, size_t size, string& out);
+
+private:
+    CompressCache();
+    CompressCache(const CompressCache&) = delete;
+    CompressCache& operator=(const CompressCache&) = delete;
+
+private:
+    struct Entry
+    {
+        string key;
+        struct timespec mtime;
+        off_t size;
+        /* Empty when the file did not shrink, so it is not compressed again */
+        shared_ptr<const string> data;
+    };
+    /* Most recently used first */
+    list<Entry> m_lru;
+    unordered_map<string, list<Entry>::iterator> m_index;
+    /* Keys of the variants being compressed */
+    unordered_set<string> m_inFlight;
+    size_t m_bytes;
+    size_t m_maxBytes;
+    size_t m_hits;
+    size_t m_misses;
+    Locker m_lock;
+};
+
+#endif
@@ -15,6 +15,34 @@ public:
     int port;
     /* Log writing method */
     int logWrite;
+    /* Flight-recorder ring size in KB, 0 disables it */
+    int logRing;
+    /* Number of rotated log files to keep, 0 keeps all of them */
+    int logKeep;
+    /* Size in MB after which the log file is rotated, 0 only rotates daily and by line count */
+    int logSplitMB;
+    /* Seconds after which the log file is rotated, 0 only rotates daily, by line count and by size */
+    int logSplitSeconds;
+    /* Largest request line plus headers in KB */
+    int maxHeaderKB;
+    /* Largest request body in KB */
+    int maxBodyKB;
+    /* Requests served per connection */
+    int maxRequests;
+    /* Idle timeout of persistent connections in seconds */
+    int idleTimeout;
+    /* Number of file I/O threads, 0 leaves the filesystem work to the workers */
+    int ioThreads;
+    /* Size in MB of the compressed-variant cache, 0 disables on-the-fly compression */
+    int compressCacheMB;
+    /* Asset bundle the static files are served from, empty serves them from the root directory */
+    string assetBundle;
+    /* Send responses from the thread that built them, EPOLLOUT only when the socket is full */
+    int writeThrough;
+    /* Register edge-triggered connections once and schedule each on a single owner instead of EPOLLONESHOT */
+    int singleOwner;
+    /* Answer static requests on the event loop thread in the proactor model */
+    int inlineStatic;
     /* Trigger combination mode */
     int triggerMode;
     /* lfd trigger mode */
@@ -0,0 +1,65 @@
+#ifndef _DIR_LISTING_H__
+#define _DIR_LISTING_H__
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <sys/stat.h>
+#include "Locker.h"
+#include "Template.h"
+#include "Arena.h"
+using namespace std;
+
+/*
+* Singleton cache of directory listing pages, rendered from the "listing" template with the variable
+* path and the loop entries of columns href and name. A page is built in memory the first time its
+* directory is listed and reused until the directory or the template changes, which the open-file
+* cache reports from inotify. Requests never write to disk, so concurrent listings of the same
+* directory share one page.
+*/
+class DirListingCache
+{
+public:
+    /* Pages kept */
+    static constexpr size_t MAX_ENTRIES = 256;
+
+    /* Get the globally unique instance */
+    static DirListingCache* getInstance();
+    /* Listing of the directory at path, its entries linked under urlPath, null if it cannot be read.
+       A page is built with scratch memory from the arena of the request */
+    shared_ptr<const string> get(const char* path, const char* urlPath, Arena& scratch);
+
+private:
+    DirListingCache() {}
+    DirListingCache(const DirListingCache&) = delete;
+    DirListingCache& operator=(const DirListingCache&) = delete;
+    /* Build the page, names sorted */
+    static bool render(const string& path, const string& urlPath, const Template& page, Arena& scratch,
+                       string& out);
+
+private:
+    /* What a page was built from, a page is current while the directory and its template are unchanged */
+    struct Stamp
+    {
+        ino_t ino;
+        off_t size;
+        struct timespec mtime;
+    };
+    struct Entry
+    {
+        string key;
+        Stamp stamp;
+        shared_ptr<const Template> listing;
+        shared_ptr<const string> page;
+    };
+    static void stampOf(const struct stat& st, Stamp& stamp);
+    static bool sameStamp(const Stamp& a, const Stamp& b);
+
+    /* Most recently used first */
+    list<Entry> m_lru;
+    unordered_map<string, list<Entry>::iterator> m_index;
+    Locker m_lock;
+};
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef _FILE_IO_POOL_H__
+#define _FILE_IO_POOL_H__
+
+#include <exception>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include "Web.h"
+#include "Channel.h"
+
+/*
+* Threads that do the blocking filesystem work of requests (stat, open, readahead, pread, directory scans),
+* so a slow disk only delays the requests waiting on it and never the workers or the event loop.
+* T::runFileTask() runs on a pool thread while nothing else touches the task. Finished tasks are posted
+* back to the event loop through a channel plus an eventfd registered in its epoll set.
+*/
+template<typename T>
+class FileIoPool
+{
+public:
+    FileIoPool(int threadNumber = 2, int maxTasks = 10000);
+    ~FileIoPool();
+    /* Queue a task, false if the queue is full and the caller should do the work itself */
+    bool submit(T* task);
+    /* Readable while finished tasks wait to be collected */
+    int eventFd() const { return m_eventfd; }
+    /* Called by the event loop when eventFd() is readable, take up to n finished tasks */
+    size_t collect(T** tasks, size_t n);
+
+private:
+    static void* worker(void* arg);
+    void run();
+
+private:
+    int m_threadNumber;
+    pthread_t* m_threads;
+    /* Tasks waiting for a pool thread */
+    MpmcChannel<T*> m_tasks;
+    /* Finished tasks waiting for the event loop */
+    MpmcChannel<T*> m_done;
+    /* Signals the event loop that m_done is not empty */
+    int m_eventfd;
+};
+
+template<typename T>
+FileIoPool<T>::FileIoPool(int threadNumber, int maxTasks)
+: m_tasks(maxTasks > 0 ? maxTasks : 1), m_done(maxTasks > 0 ? maxTasks : 1)
+{
+    if (threadNumber <= 0 || maxTasks <= 0) {
+        throw std::exception();
+    }
+    m_threadNumber = threadNumber;
+    m_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_eventfd == -1) {
+        throw std::exception();
+    }
+    m_threads = new pthread_t[m_threadNumber];
+    for (int i = 0; i < threadNumber; ++i) {
+        if (pthread_create(m_threads + i, nullptr, worker, this) != 0) {
+            delete [] m_threads;
+            throw std::exception();
+        }
+        if (pthread_detach(m_threads[i]) != 0) {
+            delete [] m_threads;
+            throw std::exception();
+        }
+    }
+}
+
+template<typename T>
+FileIoPool<T>::~FileIoPool()
+{
+    m_tasks.close();
+    delete [] m_threads;
+    close(m_eventfd);
+}
+
+template<typename T>
+bool FileIoPool<T>::submit(T* task)
+{
+    return m_tasks.tryPush(task);
+}
+
+template<typename T>
+size_t FileIoPool<T>::collect(T** tasks, size_t n)
+{
+    /* Clear the counter first, a task finishing meanwhile makes the eventfd readable again */
+    uint64_t count = 0;
+    ssize_t ret = read(m_eventfd, &count, sizeof(count));
+    (void)ret;
+    size_t got = 0;
+    while (got < n && m_done.tryPop(tasks[got])) {
+        got++;
+    }
+    /* Tasks left behind need another wakeup */
+    if (got == n && !m_done.isEmpty()) {
+        uint64_t one = 1;
+        ret = write(m_eventfd, &one, sizeof(one));
+    }
+    return got;
+}
+
+template<typename T>
+void* FileIoPool<T>::worker(void* arg)
+{
+    FileIoPool* pool = (FileIoPool*)arg;
+    pool->run();
+    return pool;
+}
+
+template<typename T>
+void FileIoPool<T>::run()
+{
+    T* task = nullptr;
+    while (m_tasks.pop(task)) {
+        task->runFileTask();
+        /* The loop drains m_done on every wakeup, so waiting for room here is brief */
+        m_done.push(task);
+        uint64_t one = 1;
+        ssize_t ret = write(m_eventfd, &one, sizeof(one));
+        (void)ret;
+    }
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef _FORM_PARSER_H__
+#define _FORM_PARSER_H__
+
+#include <cstddef>
+#include <cstring>
+using namespace std;
+
+/* A slice of a buffer, not owned */
+struct StringSlice
+{
+    const char* data;
+    size_t len;
+
+    bool equals(const char* text) const { return strlen(text) == len && memcmp(text, data, len) == 0; }
+};
+
+/* A field of a form, both parts decoded */
+struct FormField
+{
+    StringSlice name;
+    StringSlice value;
+};
+
+/*
+* Parser of application/x-www-form-urlencoded bodies and query strings. Fields are split on '&' and
+* '=' first, then each name and value is decoded in place, so the result is slices of the caller's
+* buffer and nothing is copied or allocated. The scans for separators and escapes look at 16 bytes
+* at a time with SSE2 where it is available, a field without escapes is not written at all.
+*/
+class FormParser
+{
+public:
+    /* Fields kept, further ones are ignored */
+    static constexpr size_t MAX_FIELDS = 16;
+
+    FormParser(): m_count(0) {}
+    /* Split data into fields and decode them in place, the number of fields */
+    size_t parse(char* data, size_t len);
+    /* Value of the first field named name, false if there is none */
+    bool get(const char* name, StringSlice& value) const;
+    size_t count() const { return m_count; }
+    const FormField& field(size_t i) const { return m_fields[i]; }
+
+    /* Decode %XX and '+' in place, the decoded length. A malformed escape is kept as it is */
+    static size_t decode(char* data, size_t len);
+
+private:
+    /* First byte in [p, end) equal to a or b, end if there is none */
+    static const char* find(const char* p, const char* end, char a, char b);
+
+private:
+    FormField m_fields[MAX_FIELDS];
+    size_t m_count;
+};
+
+#endif
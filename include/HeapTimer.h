@@ -3,6 +3,7 @@
 #include <unordered_map>
 #include <netinet/in.h>
 #include <time.h>
+#include "ObjectPool.h"
 using namespace std;
 
 #define BUFFER_SIZE	64
@@ -25,7 +26,7 @@ public:
 
 public:
     time_t expire;					/* The absolute time when the timer will expire */
-    void (*cbFunc)(ClientData*);	/* Callback function of the timer */
+    bool (*cbFunc)(ClientData*);	/* Callback function of the timer, false keeps it with the expire time the callback set */
     ClientData* userData;			/* User data */
     int loc;						/* The position of the timer in the heap */
 };
@@ -37,10 +38,14 @@ public:
     TimeHeap();
     /* Initialize an empty heap with capacity cap */
     TimeHeap(int cap);
-    /* Initialize the heap with an existing array */
-    TimeHeap(HeapTimer** initArray, int size, int capacity);
     /* Destroy the time heap */
     ~TimeHeap();
+    /* Allocate a timer from the heap's pool, it is released by delTimer/popTimer */
+    HeapTimer* createTimer(int delay);
+    /* Size the heap array and the timer pool for n timers up front */
+    void reserve(int n);
+    /* Occupancy of the timer pool */
+    PoolStats timerStats() const;
     /* Add a target timer */
     void addTimer(HeapTimer* timer);
     /* Delete a target timer */
@@ -74,4 +79,5 @@ private:
     HeapTimer** array;						// Heap array
     int capacity;							// Capacity of the heap array
     int curSize;							// Current number of elements in the heap array
+    ObjectPool<HeapTimer> timerPool;		// Slabs the timers are carved from
 };
\ No newline at end of file
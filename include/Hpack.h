@@ -0,0 +1,74 @@
+#ifndef _HPACK_H__
+#define _HPACK_H__
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+using namespace std;
+
+/* A header field of an HTTP/2 header block */
+struct HeaderField
+{
+    string name;
+    string value;
+};
+
+/*
+* HPACK (RFC 7541) decoder of one HTTP/2 connection: static and dynamic table, integer and
+* string literals, Huffman coded strings. Header blocks must be decoded in the order they arrive,
+* since each one may change the dynamic table the next one refers to.
+*/
+class HpackDecoder
+{
+public:
+    /* maxTableSize is the SETTINGS_HEADER_TABLE_SIZE announced to the peer */
+    explicit HpackDecoder(size_t maxTableSize = 4096);
+
+    /* Decode a complete header block, false on a compression error which is fatal to the connection */
+    bool decode(const uint8_t* data, size_t len, vector<HeaderField>& headers);
+
+private:
+    bool decodeInteger(const uint8_t*& p, const uint8_t* end, int prefix, uint64_t& value);
+    bool decodeString(const uint8_t*& p, const uint8_t* end, string& out);
+    /* Field at a combined static and dynamic table index */
+    bool lookup(uint64_t index, HeaderField& field) const;
+    void insert(const HeaderField& field);
+    /* Drop the oldest entries until the table fits size bytes */
+    void evict(size_t size);
+
+private:
+    /* Dynamic table, newest entry first */
+    deque<HeaderField> m_table;
+    /* Size of the dynamic table as RFC 7541 counts it, 32 bytes of overhead per entry */
+    size_t m_tableSize;
+    /* Current limit set by the peer through dynamic table size updates */
+    size_t m_tableLimit;
+    /* Upper bound of m_tableLimit */
+    size_t m_maxTableSize;
+};
+
+/* HPACK encoder that never indexes, so it keeps no state: names come from the static table, values are literal */
+class HpackEncoder
+{
+public:
+    /* Append :status */
+    static void encodeStatus(int status, string& out);
+    /* Append a field whose name is static table entry nameIndex, as a literal without indexing */
+    static void encodeField(int nameIndex, const char* value, size_t len, string& out);
+    /* Static table indexes of the names the server sends */
+    static constexpr int CONTENT_ENCODING = 26;
+    static constexpr int CONTENT_LENGTH = 28;
+    static constexpr int CONTENT_TYPE = 31;
+    static constexpr int DATE = 33;
+    static constexpr int ETAG = 34;
+    static constexpr int VARY = 59;
+
+private:
+    static void encodeInteger(uint64_t value, int prefix, uint8_t first, string& out);
+};
+
+/* Decode a Huffman coded string literal, false if the padding or a code is invalid */
+bool huffmanDecode(const uint8_t* data, size_t len, string& out);
+
+#endif
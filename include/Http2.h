@@ -0,0 +1,166 @@
+#ifndef _HTTP2_H__
+#define _HTTP2_H__
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Hpack.h"
+#include "ObjectPool.h"
+using namespace std;
+
+class HttpConn;
+
+/*
+* Cleartext HTTP/2 (RFC 7540) on top of one HttpConn: frames are parsed from the connection's read buffer
+* and written into its write buffer, so the epoll, timer and write paths are the HTTP/1.1 ones.
+* Each stream is answered by the connection's own doRequest() and processWrite(), whose output helpers
+* hand the status and body to the session instead of formatting HTTP/1.1. DATA frames of all open
+* streams are interleaved round robin within the peer's flow-control windows.
+*/
+class Http2Session
+{
+public:
+    /* Connection preface the client starts with */
+    static const char PREFACE[];
+    static constexpr int PREFACE_LEN = 24;
+    /* Largest frame payload accepted, the protocol default */
+    static constexpr uint32_t MAX_FRAME_SIZE = 16384;
+    /* Streams a client may have open at once */
+    static constexpr uint32_t MAX_CONCURRENT_STREAMS = 128;
+    /* Streams per slab of the session's stream pool */
+    static constexpr int STREAM_SLAB = 16;
+    /* Body bytes framed per process() call, so one connection cannot monopolize a worker */
+    static constexpr size_t FLUSH_BUDGET = 1024 * 1024;
+
+    /* Frame types and flags */
+    enum FRAME_TYPE { FRAME_DATA = 0, FRAME_HEADERS, FRAME_PRIORITY, FRAME_RST_STREAM,
+                      FRAME_SETTINGS, FRAME_PUSH_PROMISE, FRAME_PING, FRAME_GOAWAY,
+                      FRAME_WINDOW_UPDATE, FRAME_CONTINUATION };
+    enum FRAME_FLAG { FLAG_END_STREAM = 0x1, FLAG_ACK = 0x1, FLAG_END_HEADERS = 0x4,
+                      FLAG_PADDED = 0x8, FLAG_PRIORITY = 0x20 };
+    /* Error codes of RST_STREAM and GOAWAY */
+    enum ERROR_CODE { NO_ERROR = 0, PROTOCOL_ERROR, INTERNAL_ERROR, FLOW_CONTROL_ERROR,
+                      SETTINGS_TIMEOUT, STREAM_CLOSED, FRAME_SIZE_ERROR, REFUSED_STREAM,
+                      CANCEL, COMPRESSION_ERROR };
+
+public:
+    explicit Http2Session(HttpConn* conn);
+    ~Http2Session();
+
+    /* Take over after "Upgrade: h2c": settings is the HTTP2-Settings header, and the request
+       already handled with result ret is answered as stream 1 */
+    void upgrade(const string& settings, int ret);
+    /* Handle every complete frame in the read buffer and queue what has to be sent */
+    void process();
+    /* Whether DATA is ready to be framed once the queued frames are written */
+    bool wantsWrite() const;
+    /* The queued frames are written, release what they referenced */
+    void onWriteComplete();
+    /* Whether the connection closes once the queued frames are written */
+    bool isClosing() const;
+
+    /* Response capture: while a stream is answered the HttpConn output helpers land here */
+    bool capturing() const { return m_current != nullptr; }
+    void setStatus(int status);
+    void appendBody(const char* data, size_t len);
+    /* The stream takes over the mapping */
+    void setFileBody(char* address, size_t size);
+    /* The stream takes over the file, it is read frame by frame as the windows allow */
+    void setFileStream(int fd, size_t size);
+    /* The body is memory kept alive by hold, a cached variant or a bundle */
+    void setSharedBody(const char* data, size_t size, shared_ptr<const void> hold);
+    /* A response header besides :status and content-length, its name a static table entry */
+    void addHeader(int nameIndex, const char* value, size_t len);
+
+private:
+    struct Stream
+    {
+        uint32_t id;
+        /* Bytes the peer lets us send on this stream */
+        int64_t sendWindow;
+        /* The peer sent END_STREAM */
+        bool remoteClosed;
+        /* The request body went over the limit and is dropped */
+        bool tooLarge;
+        string method;
+        string path;
+        string body;
+        /* Codings of accept-encoding, a mask of ContentEncoding */
+        int acceptEncoding;
+        string ifNoneMatch;
+        int status;
+        /* Encoded response headers added by the handlers */
+        string respHeaders;
+        /* The response body: generated bytes, a mapped file, shared memory or a file read as it is sent */
+        string respBody;
+        char* fileAddress;
+        /* Owner of fileAddress when it is shared memory rather than a mapping of the stream */
+        shared_ptr<const void> fileHold;
+        int fileFd;
+        size_t fileSize;
+        /* Body bytes already framed */
+        size_t sent;
+    };
+
+    void handleFrame(uint8_t type, uint8_t flags, uint32_t streamId, const uint8_t* payload, uint32_t len);
+    void handleHeaders(uint8_t flags, uint32_t streamId, const uint8_t* payload, uint32_t len);
+    void handleData(uint8_t flags, uint32_t streamId, const uint8_t* payload, uint32_t len);
+    /* The header block of streamId is complete */
+    void finishHeaders(uint32_t streamId, bool endStream);
+    bool applySettings(const uint8_t* payload, uint32_t len);
+    /* Run the request of a stream through the HTTP/1.1 handlers and send its HEADERS */
+    void dispatch(Stream* stream, int ret);
+    void dispatch(Stream* stream);
+    /* Frame DATA of the streams in the send queue */
+    void flush();
+    void closeStream(Stream* stream);
+    /* Frame the next len bytes of a streamed file, false if the file could not be read */
+    bool readFileFrame(Stream* stream, size_t len, bool last);
+
+    void writeFrame(uint8_t type, uint8_t flags, uint32_t streamId, const void* payload, uint32_t len);
+    void writeFrameHeader(uint8_t type, uint8_t flags, uint32_t streamId, uint32_t len);
+    static void packFrameHeader(uint8_t* header, uint8_t type, uint8_t flags, uint32_t streamId, uint32_t len);
+    void writeWindowUpdate(uint32_t streamId, uint32_t increment);
+    void writeRstStream(uint32_t streamId, uint32_t error);
+    /* Send GOAWAY and close the connection once it is written */
+    void goAway(uint32_t error);
+    /* Queue everything written since the last call, followed by an optional file slice */
+    void queueOutput(char* fileAddress = nullptr, size_t fileSize = 0);
+
+private:
+    HttpConn* m_conn;
+    HpackDecoder m_decoder;
+    unordered_map<uint32_t, Stream*> m_streams;
+    /* Slots of open streams, reused by the streams that follow on the connection */
+    ObjectPool<Stream> m_streamPool;
+    /* Streams with body left to frame, in round-robin order */
+    deque<uint32_t> m_sendQueue;
+    /* Stream being answered, target of the response capture */
+    Stream* m_current;
+    /* Mappings of finished streams, released once the frames referencing them are written */
+    vector<pair<char*, size_t> > m_retired;
+    vector<shared_ptr<const void> > m_retiredHolds;
+    /* Write buffer bytes already queued */
+    size_t m_queuedUpTo;
+    bool m_prefaceSeen;
+    /* Header block being assembled from HEADERS and CONTINUATION frames */
+    string m_headerBlock;
+    uint32_t m_continuationStream;
+    bool m_continuationEndStream;
+    /* Highest stream opened by the peer */
+    uint32_t m_lastStreamId;
+    /* Connection-level window for sending */
+    int64_t m_sendWindow;
+    /* Peer settings */
+    int64_t m_peerInitialWindow;
+    uint32_t m_peerMaxFrameSize;
+    /* GOAWAY was sent, or received and the open streams are answered */
+    bool m_closing;
+    bool m_goawayReceived;
+};
+
+#endif
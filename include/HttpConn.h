@@ -1,13 +1,30 @@
 #ifndef _HTTP_CONN_H__
 #define _HTTP_CONN_H__
 
+#include <atomic>
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include "Web.h"
 #include "Locker.h"
 #include "ConnectionPool.h"
+#include "BufferPool.h"
+#include "ChainBuffer.h"
+#include "FileIoPool.h"
+#include "CompressCache.h"
+#include "AssetBundle.h"
+#include "OpenFileCache.h"
+#include "DirListing.h"
+#include "Template.h"
+#include "Router.h"
+#include "FormParser.h"
+#include "Arena.h"
+#include "MimeTypes.h"
+#include "ResponseHead.h"
 using namespace std;
 
+class Http2Session;
+
 struct UserInfo
 {
     UserInfo(string name, string pwd): userName(name), password(pwd) {}
@@ -17,13 +34,30 @@ struct UserInfo
 
 class HttpConn
 {
+    /* An HTTP/2 session parses and writes the connection's buffers and answers streams through its handlers */
+    friend class Http2Session;
+
 public:
     /* Maximum length of the filename */
     static constexpr int FILENAME_LEN = 200;
-    /* Size of the read buffer */
+    /* Initial size of the read buffer, it grows up to the header and body limits */
     static constexpr int READ_BUFFER_SIZE = 2048;
-    /* Size of the write buffer */
+    /* Size of each chunk of the write buffer */
     static constexpr int WRITE_BUFFER_SIZE = 1024;
+    /* Stack buffer that takes what does not fit the read buffer, so one readv drains the socket */
+    static constexpr int READ_SPILL_SIZE = 65536;
+    /* Longest chunk-size or trailer line accepted in a chunked request body */
+    static constexpr int CHUNK_LINE_MAX = 1024;
+    /* Size of a registration statement, a longer one is refused rather than cut off */
+    static constexpr int MAX_SQL_SIZE = 512;
+    /* Maximum number of pipelined responses queued before they are written */
+    static constexpr int MAX_PIPELINE = 16;
+    /* Files larger than this are not mapped but read one window of this size at a time */
+    static constexpr int STREAM_WINDOW = 256 * 1024;
+    /* Bytes read from one connection per wakeup, the rest waits until the other ready connections had their turn */
+    static constexpr int READ_BUDGET = 256 * 1024;
+    /* Bytes written to one connection per turn, a large response goes on after the other ready connections */
+    static constexpr size_t WRITE_BUDGET = 512 * 1024;
     /* HTTP request methods */
     enum METHOD { GET = 0, POST, HEAD, PUT, DELETE,
                   TRACE, OPTIONS, CONNECT, PATCH };
@@ -31,25 +65,42 @@ public:
     enum CHECK_STATE { CHECK_STATE_REQUESTLINE = 0,
                        CHECK_STATE_HEADER,
                        CHECK_STATE_CONTENT };
+    /* States of the chunked request body decoder */
+    enum CHUNK_STATE { CHUNK_SIZE = 0, CHUNK_DATA,
+                       CHUNK_DATA_END, CHUNK_TRAILER };
     /* Possible results of the server processing an HTTP request */
     enum HTTP_CODE { NO_REQUEST, GET_REQUEST, BAD_REQUEST,
                      NO_RESOURCE, FORBIDDEN_REQUEST, FILE_REQUEST,
-                     INTERNAL_ERROR, CLOSED_CONNECTION };
+                     INTERNAL_ERROR, CLOSED_CONNECTION,
+                     ENTITY_TOO_LARGE, HEADER_TOO_LARGE,
+                     DYNAMIC_REQUEST, FILE_PENDING, NOT_MODIFIED,
+                     ROUTE_PENDING };
+    /* Filesystem work of a request, done by the file I/O pool while the connection waits */
+    enum FILE_TASK { TASK_NONE = 0, TASK_OPEN_FILE, TASK_READ_WINDOW };
     /* Line reading status */
     enum LINE_STATUS { LINE_OK = 0, LINE_BAD, LINE_OPEN };
+    /* Outcome of sending the queued responses */
+    enum WRITE_STATUS { WRITE_ERROR = 0, WRITE_AGAIN, WRITE_CLOSE, WRITE_DONE };
+    /* Who holds a connection in single-owner scheduling */
+    enum OWNER_STATE { OWNER_NONE = 0, OWNER_HELD, OWNER_NOTIFIED };
 
 public:
-    HttpConn(){};
-    ~HttpConn(){};
+    HttpConn();
+    ~HttpConn();
 
 public:
     /* Initialize a newly accepted connection */
-    void init(int sockfd, const sockaddr_in& addr, char* root, TriggerMode mode,
-            int closeLog, string user, string password, string dbName);
-    /* Close the connection */
+    void init(int sockfd, const sockaddr_in& addr, char* root, TriggerMode mode, int closeLog);
+    /* Close the connection. The socket and its timer belong to the event loop, so the connection is only
+       marked and parked, and its next event has the loop remove the timer and close the socket */
     void closeConn(bool realClose = true);
+    /* Whether the connection was closed and waits for the event loop to close the socket */
+    bool isClosing() const { return m_closing; }
     /* Process client request */
     void process();
+    /* Answer the buffered static requests on the event loop thread; false if the connection needs a worker,
+       for a routed request or HTTP/2, and is to be handed to the thread pool as it is */
+    bool processOnLoop();
     /* Non-blocking read operation */
     bool readn();
     /* Non-blocking write operation */
@@ -58,10 +109,59 @@ public:
     sockaddr_in* getAddress();
     /* Pre-read all user information from the database */
     void initMysqlResult(ConnectionPool* connPool);
+    /* Return the read and write buffers to the pool, an idle connection holds none */
+    void releaseBuffers();
+    /* Whether pipelined bytes are left in the read buffer, or HTTP/2 frames are ready, after the queued responses were written */
+    bool hasBufferedRequest() const;
+    /* Whether the connection waits for a new request with nothing buffered */
+    bool isIdle() const { return m_readIdx == 0; }
+    /* Take the connection for handling events, called by the event loop; the events of the direction it waits
+       for, 0 if another thread holds it, which has the events reported again when it parks the connection */
+    uint32_t claim(uint32_t events);
+    /* Do the pending filesystem task, called on a file I/O thread; process() picks up the result */
+    void runFileTask();
+    /* Whether the file I/O pool holds the connection, until the event loop takes it back with leaveFileIo() */
+    bool inFileIo() const { return m_inFileIo.load(memory_order_acquire); }
+    void leaveFileIo() { m_inFileIo.store(false, memory_order_relaxed); }
 
 private:
     /* Initialize the connection */
     void init();
+    /* Reset the parser for the next request on the same connection */
+    void resetRequest();
+    /* Move the bytes of the unfinished request to the front of the read buffer */
+    void compactReadBuffer();
+    /* Move the unfinished request into a read buffer of at least size bytes */
+    void growReadBuffer(size_t size);
+    /* Move the unfinished request to dest, which may be the current buffer */
+    void moveReadBuffer(char* dest);
+    /* Record the response just written to the write buffer in the response queue, followed by an optional
+       body outside of it; a mapped body is unmapped once sent */
+    void queueResponse(size_t headStart, char* body, size_t bodyLen, bool mapped);
+    /* Queue the cached body after the head just written */
+    void queueSharedBody(size_t headStart);
+    /* Queue the body of the bundled asset after the head just written */
+    void queueAsset(size_t headStart);
+    /* Start streaming the opened file after the head just written */
+    bool queueFileStream(size_t headStart);
+    /* Read the next window of the streamed file */
+    void readStreamWindow();
+    /* Queue the window just read */
+    bool queueStreamWindow(size_t headStart);
+    /* Close the streamed file and give its window back to the pool */
+    void closeFileStream();
+    /* Lay out the queued responses as one iovec array for writev */
+    void prepareWrite();
+    /* Wait for the socket to become readable (EPOLLIN) or writable (EPOLLOUT) and let go of the connection */
+    void park(int ev);
+    /* Send the laid out responses until done or the socket is full, without arming any event */
+    WRITE_STATUS sendQueued();
+    /* Send the responses just built from the worker; whether buffered requests are left for another pass */
+    bool writeThrough();
+    /* Answer the complete requests in the read buffer once; whether process() should go on */
+    bool processOnce();
+    /* Whether the connection opens with the HTTP/2 connection preface, or the part of it received so far */
+    bool startsWithPreface() const;
     /* Parse the HTTP request */
     HTTP_CODE processRead();
     /* Populate the HTTP response */
@@ -71,7 +171,25 @@ private:
     HTTP_CODE parseRequestLine(char* text);
     HTTP_CODE parseHeaders(char* text);
     HTTP_CODE parseContent(char* text);
+    HTTP_CODE parseChunked();
     HTTP_CODE doRequest();
+    /* Stat, open and map or prepare the target file for streaming */
+    HTTP_CODE openFile();
+    /* Pick the coding of a text file: true if the body is now a cached compressed variant, otherwise
+       m_realFile and file may now be a prebuilt sibling */
+    bool negotiateEncoding(shared_ptr<const OpenFile>& file);
+    /* Whether path resolves to the root directory or something in it */
+    bool underDocRoot(const char* path) const;
+    /* Look the URL up in the asset bundle and pick the coding to send, false if the bundle does not hold it */
+    bool findAsset();
+    /* If-None-Match names the ETag of the asset */
+    bool assetNotModified() const;
+    /* Codings of an Accept-Encoding value the server can produce */
+    static int parseAcceptEncoding(const char* text);
+    /* Hand the pending filesystem task to the file I/O pool, or do it right away when it cannot take it */
+    bool submitFileTask();
+    /* Result of the finished filesystem task */
+    HTTP_CODE takeFileResult();
     char* getLine() { return m_readBuf + m_startLine; }
     LINE_STATUS parseLine();
 
@@ -79,18 +197,37 @@ private:
     void unmap();
     bool addResponse(const char* format, ...);
     bool addContent(const char* content);
-    bool addStatusLine(int status, const char* title);
-    bool addHeaders(int contentLength);
-    bool addContentLength(int contentLength);
+    /* Status line and Date */
+    bool addStatusLine(int status);
+    /* Content-Type of m_mimeType, Content-Length, Connection and the blank line */
+    bool addHeaders(long contentLength);
+    bool addContentType();
+    bool addContentLength(long contentLength);
+    bool addEncodingHeaders();
+    bool addAssetHeaders();
     bool addLinger();
     bool addBlankLine();
+    /* The whole prebuilt response of an error status */
+    bool addCanned(int status);
+    /* A body of unknown length: chunked for HTTP/1.1, delimited by closing the connection for HTTP/1.0 */
+    bool addStreamHeaders();
+    bool addChunk(const char* data, size_t len);
+    bool addLastChunk();
 
     /* Parse the submitted username and password from the POST request body */
-    int getNameAndPwd(string& name, string& password);
+    bool getNameAndPwd(StringSlice& name, StringSlice& password);
+    /* Cut the query string off a request target in place, the handlers take their fields from the body */
+    static void stripQuery(char* target);
+    /* Handler of a routed endpoint: FILE_REQUEST to serve the file m_url names, or the response code */
+    typedef HTTP_CODE (HttpConn::*Handler)();
+    /* Endpoints answered by handlers instead of files */
+    static const Router<Handler>& routes();
     /* Handle different CGI methods */
-    void CGI_UserLog();
-    void CGI_UserRegist();
-    void CGI_MusicList();
+    HTTP_CODE CGI_UserLog();
+    HTTP_CODE CGI_UserRegist();
+    HTTP_CODE CGI_MusicList();
+    /* Generator of the welcome page, rendered from its template for the user who logged in */
+    bool CGI_Welcome();
 
 
 public:
@@ -98,12 +235,30 @@ public:
     static int m_epollfd;
     /* Count of connected users */
     static int m_userCount;
+    /* File I/O pool doing the filesystem work of requests, null to do it on the worker */
+    static FileIoPool<HttpConn>* m_ioPool;
+    /* Largest request line plus headers accepted, answered with 431 beyond it */
+    static int m_maxHeaderSize;
+    /* Largest request body accepted, answered with 413 beyond it */
+    static int m_maxBodySize;
+    /* Requests served on one connection before it is closed, 0 for no limit */
+    static int m_maxRequests;
+    /* Seconds an idle persistent connection is kept, announced in the Keep-Alive header */
+    static int m_idleTimeout;
+    /* process() sends the responses it built, EPOLLOUT is armed only when the socket cannot take them */
+    static bool m_writeThrough;
+    /* Sockets are registered once, edge triggered, and the thread holding a connection is its only owner */
+    static bool m_singleOwner;
+    /* Static requests are answered by the event loop thread, only routed ones go to the thread pool */
+    static bool m_inlineStatic;
+    /* Set on the event loop thread */
+    static thread_local bool m_onLoop;
 
     int m_timerFlag;
     int m_improv;
     /* Database connection handle */
     MYSQL* m_mysql;
-    /* Read: 0, Write: 1 */
+    /* Read: 0, Write: 1, Resume after file I/O: 2 */
     int m_state;
 
 private:
@@ -111,18 +266,20 @@ private:
     int m_sockfd;
     /* Socket address of the other end */
     sockaddr_in m_address;
-    /* Read buffer */
-    char m_readBuf[READ_BUFFER_SIZE];
+    /* Read buffer, borrowed from the buffer pool while a request is being read */
+    char* m_readBuf;
+    /* Capacity of the read buffer */
+    size_t m_readSize;
     /* Index of the last byte of client data that has been read into the read buffer */
     int m_readIdx;
+    /* Start of the request currently being parsed, everything before it has been answered */
+    int m_requestStart;
     /* Index of the current character being analyzed in the read buffer */
     int m_checkedIdx;
     /* Start position of the line currently being parsed */
     int m_startLine;
-    /* Write buffer */
-    char m_writeBuf[WRITE_BUFFER_SIZE];
-    /* Number of bytes waiting to be sent in the write buffer */
-    int m_writeIdx;
+    /* Write buffer, chunks are borrowed from the buffer pool while responses are being sent */
+    ChainBuffer m_writeBuf;
 
     /* Current position of the main state machine */
     CHECK_STATE m_checkState;
@@ -131,20 +288,53 @@ private:
 
     /* Root directory of the website */
     char* m_docRoot;
-    /* Full path of the target file requested by the client, equivalent to the website root directory + m_url */
-    char m_realFile[FILENAME_LEN];
     /* File name of the target file requested by the client */
-    char* m_url;
-    /* HTTP protocol version number, only support HTTP/1.1 */
+    const char* m_url;
+    /* HTTP protocol version number, HTTP/1.0 or HTTP/1.1 */
     char* m_version;
     /* Host name */
     char* m_host;
-    /* Length of the HTTP request message body */
+    /* ETags of If-None-Match */
+    const char* m_ifNoneMatch;
+    /* Length of the HTTP request message body, decoded so far for a chunked body */
     int m_contentLength;
-    /* Whether the HTTP request requires keeping the connection alive */
+    /* Whether the request is HTTP/1.1 rather than HTTP/1.0 */
+    bool m_http11;
+    /* Whether the request body uses chunked transfer encoding */
+    bool m_chunked;
+    /* Position of the chunked body decoder */
+    CHUNK_STATE m_chunkState;
+    /* Bytes of the current chunk not decoded yet */
+    long m_chunkSize;
+    /* First byte of the chunked body not decoded yet */
+    int m_rawIdx;
+    /* The request asked to upgrade to cleartext HTTP/2 */
+    bool m_upgradeH2c;
+    /* HTTP2-Settings header sent with the upgrade */
+    string m_h2Settings;
+    /* HTTP/2 session once the connection speaks HTTP/2 */
+    Http2Session* m_http2;
+    /* Handler that writes a generated response straight into the write buffer */
+    bool (HttpConn::*m_generator)();
+    /* Template the generator renders, and the user it greets, a slice of the request body */
+    shared_ptr<const Template> m_page;
+    StringSlice m_userName;
+    /* Whether the connection stays open after this request: the default of its HTTP version, overridden by Connection */
     bool m_linger;
+    /* Number of requests answered on this connection */
+    int m_requestCount;
     /* EPOLL trigger mode */
     TriggerMode m_mode;
+    /* OWNER_STATE of the connection, changed by the event loop and the thread that parks it */
+    atomic<int> m_owner;
+    /* Submitted to the file I/O pool and not taken back by the event loop yet */
+    atomic<bool> m_inFileIo;
+    /* Parked for EPOLLOUT rather than EPOLLIN */
+    bool m_waitWrite;
+    /* The last read stopped at EAGAIN, so the next bytes to arrive raise a new edge */
+    bool m_readDrained;
+    /* The last write stopped at EAGAIN, so the space it waits for raises a new edge */
+    bool m_writeBlocked;
     /* Whether logging is disabled */
     int m_closeLog;
     /* Whether POST is enabled */
@@ -152,25 +342,79 @@ private:
 
     /* Starting position in memory where the target file requested by the client is mmap'ed */
     char* m_fileAddress;
+    /* Full path of the target file, the website root directory + m_url */
+    char m_realFile[FILENAME_LEN];
+    /* Filesystem task the connection waits for, or whose result is not picked up yet */
+    FILE_TASK m_fileTask;
+    HTTP_CODE m_taskResult;
+    /* The file I/O queue was full on the event loop, the task is run by the worker the connection is passed to */
+    bool m_taskOnWorker;
+    /* The request is parsed and its handler waits for a worker, which resumes it with doRequest() */
+    bool m_routePending;
+    /* The event loop stopped at work it leaves to a worker */
+    bool m_passOn;
+    /* Bytes read by a TASK_READ_WINDOW, -1 on error */
+    ssize_t m_taskBytes;
+    /* Codings the client accepts, a mask of ContentEncoding */
+    int m_acceptEncoding;
+    /* Coding of the response body */
+    ContentEncoding m_contentEncoding;
+    /* The response depends on Accept-Encoding */
+    bool m_vary;
+    /* Type of the response body, null to send no Content-Type */
+    const MimeType* m_mimeType;
+    /* Body from one of the caches: a compressed variant or a directory listing */
+    shared_ptr<const string> m_cachedBody;
+    /* Asset bundle answering the request, and the entry of the URL */
+    shared_ptr<const AssetBundle> m_bundle;
+    const BundleEntry* m_asset;
+    /* Target file too large to be mapped, opened for streaming */
+    int m_fileFd;
+    /* File being streamed through the window, the response queue ends with its current window */
+    int m_streamFd;
+    off_t m_streamOffset;
+    size_t m_streamRemaining;
+    char* m_streamBuf;
+    size_t m_streamBufSize;
     /* Status of the target file (whether it exists, whether it is a directory, whether it is readable, etc.) */
     struct stat m_fileStat;
-    /* Use writev to perform write operations */
-    struct iovec m_iv[2];
+    /* A response waiting to be sent: its head in the write buffer, then an optional body */
+    struct PendingResponse
+    {
+        size_t headStart;
+        size_t headLen;
+        char* body;
+        size_t bodyLen;
+        /* The body is a file mapping owned by the queue */
+        bool mapped;
+        /* Keeps a cached body or a bundle alive until it is sent */
+        shared_ptr<const void> hold;
+    };
+    /* Responses to pipelined requests in request order, or the frames of an HTTP/2 session */
+    vector<PendingResponse> m_responses;
+    /* Close the connection once the queued responses are sent */
+    bool m_closeAfterWrite;
+    /* Closed by closeConn(), readn() and writen() fail until the event loop closes the socket */
+    bool m_closing;
+    /* Use writev to perform write operations, all queued responses go out in one call */
+    vector<iovec> m_iv;
     /* Number of memory blocks being written */
     int m_ivCount;
+    /* First memory block not completely sent yet */
+    int m_ivIndex;
     /* Number of bytes to be sent from the buffer */
     size_t m_bytesToSend;
     /* Number of bytes already sent from the buffer */
     size_t m_bytesHaveSend;
+    /* Bytes written since the connection was picked up for this turn */
+    size_t m_turnWritten;
 
-    /* Database username */
-    char m_dbUser[100];
-    /* Database password */
-    char m_dbPassword[100];
-    /* Database name */
-    char m_dbName[100];
-    /* Temporary storage of the content (username and password) of the POST request message body */
-    string m_namePassword;
+    /* Body of the POST request where it was received, in the read buffer or the HTTP/2 stream; valid
+       until the request is answered and decoded in place by the handlers */
+    char* m_body;
+    size_t m_bodyLen;
+    /* Scratch memory of the request being handled, released when it is answered */
+    Arena m_arena;
 };
 
 #endif
\ No newline at end of file
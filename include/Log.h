@@ -4,7 +4,10 @@
 #include <iostream>
 #include <cstdio>
 #include <cstdarg>
-#include "BlockQueue.h"
+#include <deque>
+#include "Channel.h"
+#include "Locker.h"
+#include "LogRing.h"
 using namespace std;
 
 /* Singleton class for implementing a logging system */
@@ -17,11 +20,15 @@ public:
     static Log* getInstance();
     /* Callback function for the working thread */
     static void* flushLogThread(void* arg);
-    /* Optional parameters: log file, log buffer size, maximum number of lines, and maximum log queue size */
-    bool init(const char* fileName, int closeLog, int logBufSize = 8192, int splitLines = 5000000, int maxQueueSize = 0);
+    /* Callback function for the rotation thread */
+    static void* rotateLogThread(void* arg);
+    /* Optional parameters: log file, log buffer size, maximum number of lines, maximum log queue size, flight-recorder ring size,
+       maximum bytes and seconds per file (0 disables either) and the number of rotated files to keep (0 keeps all) */
+    bool init(const char* fileName, int closeLog, int logBufSize = 8192, int splitLines = 5000000, int maxQueueSize = 0,
+              int ringSize = 0, long long splitBytes = 0, int splitSeconds = 0, int keepFiles = 0);
     /* Print log with the specified format */
     void writeLog(Level level, const char* format, ...);
-    /* Force flushing to disk */
+    /* Force flushing to disk, skipped in flight-recorder mode since the ring already holds every record */
     void flush(void);
 
 private:
@@ -33,6 +40,20 @@ private:
     Log& operator=(const Log& log) = delete;
     /* Asynchronously write log */
     void* asyncWriteLog();
+    /* Append formatted lines to the current file and wake the rotation thread when a limit is reached */
+    void writeToFile(const string* lines, int n);
+    /* Rotation thread body: swap files when a limit is reached and compress the rotated ones */
+    void* rotateLog();
+    /* Open the next file and swap it in, the old file is closed outside the lock */
+    void rotate(const struct tm& now);
+    /* Give up on this rotation and keep the current file */
+    void rotateFailed();
+    /* Gzip a rotated file next to itself and remove the original */
+    bool compress(const string& path);
+    /* Remove the oldest rotated files beyond m_keepFiles */
+    void prune();
+    /* Pick up rotated files left by earlier runs so retention covers them too */
+    void scanRotated();
 
 private:
     /* Directory name where the logs are located */
@@ -41,20 +62,44 @@ private:
     char m_logName[128];
     /* Maximum number of lines in the log */
     int m_spiltLines;
+    /* Maximum number of bytes in the log, 0 for no limit */
+    long long m_splitBytes;
+    /* Maximum age of the log in seconds, 0 for no limit */
+    int m_splitSeconds;
+    /* Number of rotated files kept on disk, 0 keeps all of them */
+    int m_keepFiles;
     /* Log buffer size */
     int m_logBufSize;
     /* Log line count */
     long long m_count;
+    /* Bytes written to the current file */
+    long long m_bytes;
+    /* Time the current file was opened */
+    time_t m_openTime;
+    /* Full name of the current file */
+    char m_fileName[301];
+    /* Suffix of the last file split off today */
+    int m_splitIndex;
+    /* Set by writers when a limit is reached, cleared by the rotation thread */
+    bool m_rotatePending;
+    /* Wakes the rotation thread */
+    Cond m_rotateCond;
+    /* Rotated files on disk, oldest first */
+    deque<string> m_rotated;
     /* Used for printing logs on a daily basis to record the current day */
     int m_today;
     /* File pointer pointing to the log file */
     FILE* m_fp;
     /* Log buffer address */
     char* m_buf;
-    /* Thread-safe blocking queue */
-    BlockQueue<string>* m_logQueue;
+    /* Lock-free queue from the logging threads to the flush thread */
+    MpmcChannel<string>* m_logQueue;
     /* Flag for asynchronous logging */	
     bool m_isAsync;
+    /* Memory-mapped ring receiving a copy of every record (flight-recorder mode) */
+    LogRing m_ring;
+    /* Flag for flight-recorder mode */
+    bool m_isRing;
     /* Mutex lock */
     Locker m_mutex;
     /* Flag for closing the log */
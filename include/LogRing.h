@@ -0,0 +1,80 @@
+#ifndef _LOG_RING_H__
+#define _LOG_RING_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/* Magic number at the start of a flight-recorder file ("WSLOGRNG") */
+static constexpr uint64_t LOG_RING_MAGIC = 0x474e52474f4c5357ULL;
+/* Marker stored last in a record header, a record without it was never completed */
+static constexpr uint32_t LOG_RECORD_COMMIT = 0x524f4345;
+static constexpr uint32_t LOG_RING_VERSION = 1;
+
+/* File header of the flight-recorder ring, the data area follows immediately */
+struct LogRingHeader
+{
+    /* Always LOG_RING_MAGIC */
+    uint64_t magic;
+    /* Layout version */
+    uint32_t version;
+    /* Size of this header, offset of the data area */
+    uint32_t headerSize;
+    /* Size of the data area in bytes, a power of two */
+    uint64_t capacity;
+    /* Total number of bytes ever reserved, the position of the next record */
+    std::atomic<uint64_t> head;
+};
+
+/* Header in front of every record, records are 8-byte aligned and may wrap around the end of the data area */
+struct LogRecordHeader
+{
+    /* LOG_RECORD_COMMIT once the payload is fully written */
+    uint32_t commit;
+    /* Payload length in bytes */
+    uint32_t length;
+    /* Absolute position of this record, tells a live record from leftovers of an earlier lap */
+    uint64_t position;
+};
+
+/*
+* Crash-safe flight recorder: log records are copied into a MAP_SHARED file mapping,
+* so they survive in the page cache even if the process dies before any fflush.
+* Writers reserve space with a single atomic add and never block each other.
+*/
+class LogRing
+{
+public:
+    LogRing();
+    ~LogRing();
+
+    /* Create or reopen the ring file, capacity is rounded up to a power of two */
+    bool open(const char* path, size_t capacity);
+    /* Append one record, records longer than a quarter of the ring are truncated */
+    void append(const char* data, size_t len);
+    /* Unmap the ring file */
+    void close();
+
+    /* Callback used by decode() for every complete record, oldest first */
+    typedef void (*RecordVisitor)(const char* data, size_t len, void* arg);
+    /* Walk the committed records of a mapped ring image, return the number of records visited */
+    static size_t decode(const char* image, size_t imageSize, RecordVisitor visitor, void* arg);
+
+private:
+    LogRing(const LogRing&) = delete;
+    LogRing& operator=(const LogRing&) = delete;
+    /* Copy n bytes to the absolute ring position pos, wrapping around the end of the data area */
+    void copyIn(uint64_t pos, const void* src, size_t n);
+
+private:
+    /* Start of the mapping */
+    LogRingHeader* m_header;
+    /* Start of the data area */
+    char* m_data;
+    /* Size of the data area */
+    uint64_t m_capacity;
+    /* Size of the whole mapping */
+    size_t m_mapSize;
+};
+
+#endif
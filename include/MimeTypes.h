@@ -0,0 +1,71 @@
+#ifndef _MIME_TYPES_H__
+#define _MIME_TYPES_H__
+
+#include <cstddef>
+#include <cstring>
+#include <strings.h>
+using namespace std;
+
+/* Media type of a file extension, with its HTTP/1.1 header line formatted when compiled */
+struct MimeType
+{
+    const char* extension;
+    const char* type;
+    size_t typeLen;
+    const char* header;
+    size_t headerLen;
+};
+
+#define MIME_TYPE(extension, type) \
+    { extension, type, sizeof(type) - 1, "Content-Type: " type "\r\n", sizeof("Content-Type: " type "\r\n") - 1 }
+
+/* Every kind of file under root/ and the common web formats; text is UTF-8 */
+static constexpr MimeType MIME_TYPES[] = {
+    MIME_TYPE("html", "text/html; charset=utf-8"),
+    MIME_TYPE("htm", "text/html; charset=utf-8"),
+    MIME_TYPE("css", "text/css; charset=utf-8"),
+    MIME_TYPE("js", "text/javascript; charset=utf-8"),
+    MIME_TYPE("json", "application/json"),
+    MIME_TYPE("txt", "text/plain; charset=utf-8"),
+    MIME_TYPE("csv", "text/csv; charset=utf-8"),
+    MIME_TYPE("xml", "application/xml"),
+    MIME_TYPE("svg", "image/svg+xml"),
+    MIME_TYPE("gif", "image/gif"),
+    MIME_TYPE("jpg", "image/jpeg"),
+    MIME_TYPE("jpeg", "image/jpeg"),
+    MIME_TYPE("png", "image/png"),
+    MIME_TYPE("webp", "image/webp"),
+    MIME_TYPE("ico", "image/x-icon"),
+    MIME_TYPE("mp3", "audio/mpeg"),
+    MIME_TYPE("ogg", "audio/ogg"),
+    MIME_TYPE("wav", "audio/wav"),
+    MIME_TYPE("mp4", "video/mp4"),
+    MIME_TYPE("webm", "video/webm"),
+    MIME_TYPE("pdf", "application/pdf"),
+    MIME_TYPE("wasm", "application/wasm"),
+    MIME_TYPE("woff", "font/woff"),
+    MIME_TYPE("woff2", "font/woff2"),
+};
+
+/* Type of anything else */
+static constexpr MimeType MIME_DEFAULT = MIME_TYPE("", "application/octet-stream");
+/* Type of generated pages and of the canned error bodies */
+static constexpr const MimeType& MIME_HTML = MIME_TYPES[0];
+static constexpr const MimeType& MIME_TEXT = MIME_TYPES[5];
+
+/* Type of a path by its extension, matched without regard to case */
+inline const MimeType& mimeTypeOf(const char* path)
+{
+    const char* dot = strrchr(path, '.');
+    if (dot == nullptr || strchr(dot, '/') != nullptr) {
+        return MIME_DEFAULT;
+    }
+    for (size_t i = 0; i < sizeof(MIME_TYPES) / sizeof(MIME_TYPES[0]); ++i) {
+        if (strcasecmp(dot + 1, MIME_TYPES[i].extension) == 0) {
+            return MIME_TYPES[i];
+        }
+    }
+    return MIME_DEFAULT;
+}
+
+#endif
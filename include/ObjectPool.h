@@ -0,0 +1,150 @@
+#ifndef _OBJECT_POOL_H__
+#define _OBJECT_POOL_H__
+
+#include <exception>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/* Occupancy statistics of an object pool */
+struct PoolStats
+{
+    /* Objects the slabs can hold */
+    int capacity;
+    /* Objects currently handed out */
+    int inUse;
+    /* Highest inUse seen so far */
+    int peak;
+    /* Number of slabs allocated */
+    int slabs;
+    /* Total number of create() calls */
+    long long allocations;
+};
+
+/*
+* Fixed-size object pool: a free list threaded through contiguous slabs of slabSize objects.
+* create() and destroy() are O(1) and never call malloc once enough slabs are reserved.
+* Not thread-safe, a pool belongs to the thread that owns the objects.
+*/
+template<typename T>
+class ObjectPool
+{
+public:
+    explicit ObjectPool(int slabSize = 256);
+    ~ObjectPool();
+
+    /* Construct an object in a free slot, growing by one slab when none is left */
+    template<typename... Args>
+    T* create(Args&&... args);
+    /* Destroy an object created by this pool and put its slot back on the free list */
+    void destroy(T* obj);
+    /* Allocate slabs up front until at least n objects fit */
+    void reserve(int n);
+    /* Current occupancy */
+    PoolStats stats() const;
+
+private:
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+    /* A free slot stores the link to the next free slot in place of the object */
+    union Slot
+    {
+        Slot* next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+    void grow();
+
+private:
+    /* Objects per slab */
+    int m_slabSize;
+    /* All slabs, released in the destructor */
+    std::vector<Slot*> m_slabs;
+    /* Head of the free list */
+    Slot* m_freeList;
+    int m_inUse;
+    int m_peak;
+    long long m_allocations;
+};
+
+template<typename T>
+ObjectPool<T>::ObjectPool(int slabSize)
+: m_slabSize(slabSize), m_freeList(nullptr), m_inUse(0), m_peak(0), m_allocations(0)
+{
+    if (slabSize <= 0) {
+        throw std::exception();
+    }
+}
+
+template<typename T>
+ObjectPool<T>::~ObjectPool()
+{
+    /* Objects still in use are the owner's responsibility, only the memory is released here */
+    for (size_t i = 0; i < m_slabs.size(); ++i) {
+        delete [] m_slabs[i];
+    }
+}
+
+template<typename T>
+void ObjectPool<T>::grow()
+{
+    Slot* slab = new Slot[m_slabSize];
+    m_slabs.push_back(slab);
+    /* Thread the new slots onto the free list in address order */
+    for (int i = m_slabSize - 1; i >= 0; --i) {
+        slab[i].next = m_freeList;
+        m_freeList = &slab[i];
+    }
+}
+
+template<typename T>
+template<typename... Args>
+T* ObjectPool<T>::create(Args&&... args)
+{
+    if (m_freeList == nullptr) {
+        grow();
+    }
+    Slot* slot = m_freeList;
+    m_freeList = slot->next;
+    T* obj = new (&slot->storage) T(std::forward<Args>(args)...);
+    m_allocations++;
+    if (++m_inUse > m_peak) {
+        m_peak = m_inUse;
+    }
+    return obj;
+}
+
+template<typename T>
+void ObjectPool<T>::destroy(T* obj)
+{
+    if (obj == nullptr) {
+        return;
+    }
+    obj->~T();
+    Slot* slot = reinterpret_cast<Slot*>(obj);
+    slot->next = m_freeList;
+    m_freeList = slot;
+    m_inUse--;
+}
+
+template<typename T>
+void ObjectPool<T>::reserve(int n)
+{
+    while ((int)m_slabs.size() * m_slabSize < n) {
+        grow();
+    }
+}
+
+template<typename T>
+PoolStats ObjectPool<T>::stats() const
+{
+    PoolStats s;
+    s.capacity = (int)m_slabs.size() * m_slabSize;
+    s.inUse = m_inUse;
+    s.peak = m_peak;
+    s.slabs = (int)m_slabs.size();
+    s.allocations = m_allocations;
+    return s;
+}
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef _OPEN_FILE_CACHE_H__
+#define _OPEN_FILE_CACHE_H__
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <time.h>
+#include <sys/stat.h>
+#include "Locker.h"
+using namespace std;
+
+/* Result of looking a path up: its metadata and, for a readable regular file, an open descriptor */
+struct OpenFile
+{
+    OpenFile();
+    ~OpenFile();
+    /* Read the whole file into out, false if it has no descriptor or the read fails */
+    bool readAll(string& out) const;
+    /* errno of the failed stat, 0 if the path exists */
+    int error;
+    /* Read-only descriptor, -1 unless the path is a regular file readable by all users */
+    int fd;
+    struct stat st;
+};
+
+/* Usage of the open-file cache */
+struct OpenFileCacheStats
+{
+    size_t entries;
+    size_t hits;
+    size_t misses;
+    size_t invalidations;
+};
+
+/*
+* Singleton cache of stat results and open descriptors under the document root, negative results
+* included, so a file served again costs neither stat nor open and a scanner probing missing paths
+* costs one hash lookup per probe. Entries expire after a short time, and inotify on every directory
+* of the root drops them as soon as a file is written, replaced or removed. Without a working
+* inotify watch nothing is cached. A descriptor stays open while a request still uses it, even if
+* its entry was dropped.
+*/
+class OpenFileCache
+{
+public:
+    /* Entries kept, which bounds the descriptors held open */
+    static constexpr size_t MAX_ENTRIES = 1024;
+    /* Seconds an entry is trusted, a safety net behind inotify */
+    static constexpr time_t VALID_SECONDS = 60;
+    static constexpr time_t NEGATIVE_SECONDS = 10;
+
+    /* Get the globally unique instance */
+    static OpenFileCache* getInstance();
+    /* Watch the directories under root, false if inotify is not available and the cache stays off */
+    bool init(const char* root);
+    /* Metadata and descriptor of path, from the cache when possible */
+    shared_ptr<const OpenFile> lookup(const char* path);
+    /* Readable when directory changes are pending, -1 while the cache is off */
+    int inotifyFd() const { return m_inotifyFd; }
+    /* Called by the event loop when inotifyFd() is readable, drop the entries of changed paths */
+    void handleEvents();
+    /* Current usage */
+    OpenFileCacheStats stats();
+
+private:
+    OpenFileCache();
+    ~OpenFileCache();
+    OpenFileCache(const OpenFileCache&) = delete;
+    OpenFileCache& operator=(const OpenFileCache&) = delete;
+    /* stat and open path without the cache */
+    static shared_ptr<OpenFile> load(const char* path);
+    /* Watch dir and every directory below it */
+    void watchTree(const string& dir);
+    /* Drop every entry, after events that may affect many paths */
+    void clear();
+
+private:
+    struct Entry
+    {
+        string path;
+        time_t expires;
+        shared_ptr<const OpenFile> file;
+    };
+    /* Most recently used first */
+    list<Entry> m_lru;
+    unordered_map<string, list<Entry>::iterator> m_index;
+    /* Directory of each inotify watch */
+    unordered_map<int, string> m_watches;
+    int m_inotifyFd;
+    /* Bumped by every invalidation, a lookup that raced with one does not store its result */
+    size_t m_generation;
+    size_t m_hits;
+    size_t m_misses;
+    size_t m_invalidations;
+    Locker m_lock;
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef _RESPONSE_HEAD_H__
+#define _RESPONSE_HEAD_H__
+
+#include <cstddef>
+#include <string>
+using namespace std;
+
+/* An error response fixed but for its Date and Connection headers: head up to them, then blank line and body */
+struct CannedResponse
+{
+    int status;
+    string head;
+    string tail;
+    /* The body alone, for HTTP/2 */
+    const char* body;
+    size_t bodyLen;
+};
+
+/*
+* The fixed parts of HTTP/1.1 response heads, prepared once so a response is assembled by copying
+* instead of formatting: status lines, the Date header (formatted at most once per second by each
+* thread), and whole error responses. Numbers are written with a two-digits-at-a-time conversion.
+*/
+class ResponseHead
+{
+public:
+    /* Longest decimal of a 64-bit value */
+    static constexpr size_t MAX_DIGITS = 20;
+
+    /* Write value in decimal at out, the number of characters written */
+    static size_t formatDecimal(char* out, unsigned long long value);
+    /* "HTTP/1.1 <status> <reason>\r\n", the line of 500 for a status not in the table */
+    static const char* statusLine(int status, size_t& len);
+    /* "Date: <IMF-fixdate>\r\n" of the current second */
+    static const char* dateHeader(size_t& len);
+    /* Response of an error status, the one of 500 for a status not in the table */
+    static const CannedResponse& canned(int status);
+};
+
+#endif
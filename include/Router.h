@@ -0,0 +1,97 @@
+#ifndef _ROUTER_H__
+#define _ROUTER_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+using namespace std;
+
+/* FNV-1a of a path up to its query string, a constant expression so routes are hashed by the compiler */
+constexpr uint32_t routeHash(const char* path, uint32_t hash = 2166136261u)
+{
+    return (*path == '\0' || *path == '?') ? hash : routeHash(path + 1, (hash ^ (uint8_t)*path) * 16777619u);
+}
+
+/* Declare a route of a handler in a table of Route, its hash and length computed when compiled */
+#define ROUTE(method, path, handler) { method, path, sizeof(path) - 1, routeHash(path), handler }
+
+/* An endpoint: method and exact path */
+template<typename Handler>
+struct Route
+{
+    int method;
+    const char* path;
+    size_t len;
+    uint32_t hash;
+    Handler handler;
+};
+
+/*
+* Handlers by method and exact path, the query string ignored. The routes are laid out once in an
+* open-addressing table indexed by their precomputed hashes, so a lookup hashes the path once and
+* usually compares one route. A method without routes is rejected by a bit test before the path is
+* read, which keeps the static GET path free of any cost however many endpoints are added.
+*/
+template<typename Handler>
+class Router
+{
+public:
+    /* Slots of the table, a power of two at least twice the number of routes */
+    static constexpr size_t SLOTS = 64;
+
+    /* Lay out count routes, which must outlive the router; throws on duplicates or too many routes */
+    Router(const Route<Handler>* routes, size_t count);
+    /* Handler of method and path, null if the request is not routed */
+    Handler find(int method, const char* path) const;
+
+private:
+    /* Route of each slot, null for an empty one */
+    const Route<Handler>* m_slots[SLOTS];
+    /* Bit per method with at least one route */
+    unsigned m_methods;
+};
+
+template<typename Handler>
+Router<Handler>::Router(const Route<Handler>* routes, size_t count): m_slots(), m_methods(0)
+{
+    if (count * 2 > SLOTS) {
+        throw exception();
+    }
+    for (size_t i = 0; i < count; ++i) {
+        const Route<Handler>& route = routes[i];
+        size_t slot = route.hash & (SLOTS - 1);
+        while (m_slots[slot] != nullptr) {
+            const Route<Handler>& other = *m_slots[slot];
+            if (other.method == route.method && other.len == route.len && memcmp(other.path, route.path, route.len) == 0) {
+                throw exception();
+            }
+            slot = (slot + 1) & (SLOTS - 1);
+        }
+        m_slots[slot] = &route;
+        m_methods |= 1u << route.method;
+    }
+}
+
+template<typename Handler>
+Handler Router<Handler>::find(int method, const char* path) const
+{
+    if (!(m_methods & (1u << method))) {
+        return nullptr;
+    }
+    /* The same hash as routeHash(), as a loop */
+    uint32_t hash = 2166136261u;
+    size_t len = 0;
+    for (; path[len] != '\0' && path[len] != '?'; ++len) {
+        hash = (hash ^ (uint8_t)path[len]) * 16777619u;
+    }
+    for (size_t slot = hash & (SLOTS - 1); m_slots[slot] != nullptr; slot = (slot + 1) & (SLOTS - 1)) {
+        const Route<Handler>& route = *m_slots[slot];
+        if (route.hash == hash && route.method == method && route.len == len && memcmp(route.path, path, len) == 0) {
+            return route.handler;
+        }
+    }
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef _TEMPLATE_H__
+#define _TEMPLATE_H__
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/stat.h>
+#include "Locker.h"
+#include "OpenFileCache.h"
+using namespace std;
+
+/* A value substituted into a template, not owned */
+struct TemplateValue
+{
+    const char* data;
+    size_t len;
+};
+
+/* Rows of a loop, row-major: the value of column c in row r is values[r * columns + c] */
+struct TemplateRows
+{
+    const TemplateValue* values;
+    size_t count;
+    size_t columns;
+};
+
+/*
+* An HTML template compiled into a flat instruction list. The syntax is a small subset of mustache:
+*   {{name}}             the value of name, HTML-escaped
+*   {{{name}}}           the value of name as it is
+*   {{#rows}}..{{/rows}} the enclosed part once per row of rows; names inside are columns of the row
+* Loops do not nest. Names are resolved to indices when the template is compiled, so rendering is a
+* walk over the instructions that hands slices of the source and of the values to a sink, with no
+* allocation and no lookup. measure() gives the length of the output first, for Content-Length.
+*/
+class Template
+{
+public:
+    /* Most variables, loops, and columns per loop a template may use, so callers can size their arrays */
+    static constexpr size_t MAX_NAMES = 32;
+
+    /* Compile source, false with a message in error if it is malformed */
+    bool compile(const string& source, string& error);
+
+    /* Index of a variable, a loop, or a column of a loop; -1 if the template does not use it */
+    int variable(const char* name) const;
+    int loop(const char* name) const;
+    int column(int loop, const char* name) const;
+    size_t variableCount() const { return m_variables.size(); }
+    size_t loopCount() const { return m_loops.size(); }
+    size_t columnCount(int loop) const { return m_loops[loop].columns.size(); }
+
+    /* Hand the output to sink(const char* data, size_t len) piece by piece. vars has variableCount()
+       entries and loops loopCount(); values not set must be empty, not null */
+    template<typename Sink>
+    void render(const TemplateValue* vars, const TemplateRows* loops, Sink& sink) const;
+    /* Length of what render() produces */
+    size_t measure(const TemplateValue* vars, const TemplateRows* loops) const;
+
+private:
+    enum OP_CODE { OP_LITERAL, OP_VARIABLE, OP_COLUMN, OP_LOOP, OP_END };
+    struct Op
+    {
+        OP_CODE code;
+        /* Output is HTML-escaped */
+        bool escape;
+        /* LITERAL: offset in the source; VARIABLE, COLUMN, LOOP: index; END: index of its LOOP */
+        size_t arg;
+        /* LITERAL: length; LOOP: index of its END */
+        size_t extra;
+    };
+    struct Loop
+    {
+        string name;
+        vector<string> columns;
+    };
+    static int indexOf(const vector<string>& names, const string& name);
+    static int addName(vector<string>& names, const string& name);
+
+    template<typename Sink>
+    static void emit(const TemplateValue& value, bool escape, Sink& sink);
+
+private:
+    string m_source;
+    vector<Op> m_ops;
+    vector<string> m_variables;
+    vector<Loop> m_loops;
+};
+
+template<typename Sink>
+void Template::emit(const TemplateValue& value, bool escape, Sink& sink)
+{
+    if (!escape) {
+        sink(value.data, value.len);
+        return;
+    }
+    /* Runs of plain characters go out in one piece, markup characters as entities */
+    size_t start = 0;
+    for (size_t i = 0; i < value.len; ++i) {
+        const char* entity;
+        switch (value.data[i]) {
+        case '&': entity = "&amp;"; break;
+        case '<': entity = "&lt;"; break;
+        case '>': entity = "&gt;"; break;
+        case '"': entity = "&quot;"; break;
+        case '\'': entity = "&#39;"; break;
+        default: continue;
+        }
+        sink(value.data + start, i - start);
+        sink(entity, strlen(entity));
+        start = i + 1;
+    }
+    sink(value.data + start, value.len - start);
+}
+
+template<typename Sink>
+void Template::render(const TemplateValue* vars, const TemplateRows* loops, Sink& sink) const
+{
+    const TemplateRows* rows = nullptr;
+    size_t row = 0;
+    for (size_t pc = 0; pc < m_ops.size(); ++pc) {
+        const Op& op = m_ops[pc];
+        switch (op.code) {
+        case OP_LITERAL:
+            sink(m_source.data() + op.arg, op.extra);
+            break;
+        case OP_VARIABLE:
+            emit(vars[op.arg], op.escape, sink);
+            break;
+        case OP_COLUMN:
+            emit(rows->values[row * rows->columns + op.arg], op.escape, sink);
+            break;
+        case OP_LOOP:
+            rows = &loops[op.arg];
+            row = 0;
+            if (rows->count == 0) {
+                pc = op.extra;
+            }
+            break;
+        case OP_END:
+            if (++row < rows->count) {
+                pc = op.arg;
+            }
+            break;
+        }
+    }
+}
+
+/*
+* Singleton of the templates under the document root, every *.tpl file compiled at startup by name
+* without the extension. A template whose file changed is compiled again on its next use, the
+* change seen through the open-file cache; pages being rendered keep the old one.
+*/
+class TemplateStore
+{
+public:
+    /* Get the globally unique instance */
+    static TemplateStore* getInstance();
+    /* Compile the templates in root, the number compiled */
+    int init(const char* root);
+    /* Template of a name, null if there is no such template or it does not compile */
+    shared_ptr<const Template> get(const char* name);
+
+private:
+    TemplateStore() {}
+    TemplateStore(const TemplateStore&) = delete;
+    TemplateStore& operator=(const TemplateStore&) = delete;
+    /* Read and compile an open template file, null if it does not compile */
+    static shared_ptr<const Template> load(const OpenFile& file);
+
+private:
+    struct Entry
+    {
+        string path;
+        ino_t ino;
+        off_t size;
+        struct timespec mtime;
+        shared_ptr<const Template> compiled;
+    };
+    string m_root;
+    unordered_map<string, Entry> m_templates;
+    Locker m_lock;
+};
+
+#endif
@@ -1,11 +1,10 @@
 #ifndef _THREADPOOL_H__
 #define _THREADPOOL_H__
 
-#include <list>
 #include <exception>
 #include <pthread.h>
 #include "Web.h"
-#include "Locker.h"
+#include "Channel.h"
 #include "ConnectionPool.h"
 
 /* Thread pool class, defined as a template class for code reuse, where T is the task class */
@@ -32,12 +31,8 @@ private:
     int m_maxRequests;
     /* Array describing the thread pool, with a size of m_threadNumber */
     pthread_t* m_threads;
-    /* Request queue */
-    std::list<T*> m_workQueue;
-    /* Mutex lock to protect the request queue */
-    Locker m_queueLocker;
-    /* Semaphore to indicate whether there are tasks to be processed */
-    Sem m_queueStat;
+    /* Lock-free request queue, idle workers sleep on its futex */
+    MpmcChannel<T*> m_workQueue;
     /* Flag to stop the threads */
     bool m_stop;
     /* Database connection pool */
@@ -48,6 +43,7 @@ private:
 
 template<typename T>
 Threadpool<T>::Threadpool(ActorModel model, ConnectionPool* connPool, int threadNumber, int maxRequests)
+: m_workQueue(maxRequests > 0 ? maxRequests : 1)
 {
     /* Parameter validation */
     if (threadNumber <= 0 || maxRequests <= 0) {
@@ -88,31 +84,15 @@ Threadpool<T>::~Threadpool()
 template<typename T>
 bool Threadpool<T>::append(T* request, int state)
 {
-    m_queueLocker.lock();
-    if (m_workQueue.size() >= m_maxRequests) {
-        m_queueLocker.unlock();
-        return false;
-    }
     request->m_state = state;
-    m_workQueue.push_back(request);
-    m_queueLocker.unlock();
-    m_queueStat.post();
-    return true;
+    return m_workQueue.tryPush(request);
 }
 
 template<typename T>
 bool Threadpool<T>::append_p(T* request)
 {
-    /* When operating on the work queue, be sure to lock it, as it is shared by all threads */
-    m_queueLocker.lock();
-    if (m_workQueue.size() >= m_maxRequests) {
-        m_queueLocker.unlock();
-        return false;
-    }
-    m_workQueue.push_back(request);
-    m_queueLocker.unlock();
-    m_queueStat.post();
-    return true;
+    /* The queue is shared by all threads, but needs no lock: producers and workers each claim a slot with one CAS */
+    return m_workQueue.tryPush(request);
 }
 
 template<typename T>
@@ -126,21 +106,18 @@ void* Threadpool<T>::worker(void* arg)
 template<typename T>
 void Threadpool<T>::run()
 {
-    while (!m_stop) {
-        m_queueStat.wait();
-        m_queueLocker.lock();
-        if (m_workQueue.empty()) {
-            m_queueLocker.unlock();
-            continue;
-        }
-        T* request = m_workQueue.front();
-        m_workQueue.pop_front();
-        m_queueLocker.unlock();
+    T* request = nullptr;
+    while (!m_stop && m_workQueue.pop(request)) {
         if (!request) {
             continue;
         }
         if (m_model == REACTOR) {
-            if (request->m_state == 0) {
+            /* Resumed after the file I/O pool, the main thread does not wait for this one */
+            if (request->m_state == 2) {
+                ConnectionRAII mysqlConn(&request->m_mysql, m_connPool);
+                request->process();
+            }
+            else if (request->m_state == 0) {
                 if (request->readn()) {
                     request->m_improv = 1;
                     ConnectionRAII mysqlConn(&request->m_mysql, m_connPool);
@@ -153,6 +130,11 @@ void Threadpool<T>::run()
             }
             else {
                 if (request->writen()) {
+                    /* Answer the pipelined requests left in the read buffer */
+                    if (request->hasBufferedRequest()) {
+                        ConnectionRAII mysqlConn(&request->m_mysql, m_connPool);
+                        request->process();
+                    }
                     request->m_improv = 1;
                 }
                 else {
@@ -6,6 +6,8 @@
 #include "Web.h"
 using namespace std;
 
+class HttpConn;
+
 class Utils
 {
 public:
@@ -30,9 +32,12 @@ public:
     static int* u_pipefd;
     TimeHeap m_timeHeap;
     static int u_epollfd;
+    /* Connections by socket, for the timer callback */
+    static HttpConn* u_users;
     int m_timeslot;
 };
 
-void cbFunc(ClientData* userData);
+/* Close the connection of an expired timer, false when it cannot be closed yet and the timer is put off */
+bool cbFunc(ClientData* userData);
 
 #endif
\ No newline at end of file
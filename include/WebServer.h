@@ -14,6 +14,8 @@ static constexpr int MAX_FD = 10000;
 static constexpr int MAX_EVENT_NUMBER = 10000;
 /* Minimum timeout unit */
 static constexpr int TIMESLOT = 5;
+/* Connections accepted per wakeup of an edge-triggered listening socket, the rest after the ready connections */
+static constexpr int ACCEPT_BUDGET = 64;
 
 class WebServer
 {
@@ -24,13 +26,18 @@ public:
     /* Initialize the web server */
     void init(int port, string dbUser, string dbPwd, string dbName, 
               int logWrite, int optLinger, int triggerMode, int sqlNum, 
-              int threadNum, int closeLog, ActorModel model);
+              int threadNum, int closeLog, ActorModel model, int logRing,
+              int logKeep, int logSplitMB, int logSplitSeconds, int maxHeaderKB, int maxBodyKB,
+              int maxRequests, int idleTimeout, int ioThreads, int compressCacheMB,
+              string assetBundle, int writeThrough, int singleOwner, int inlineStatic);
     /* Initialize the thread pool */
     void threadPoolInit();
     /* Initialize the database connection pool */
     void connectionPoolInit();
     /* Initialize the log file */
     void logWriteInit();
+    /* Load the asset bundle, packing the root directory into it first if it does not exist */
+    void assetBundleInit();
     /* Configure the trigger mode */
     void trigMode();
     /* Set up listening */
@@ -39,8 +46,8 @@ public:
     void eventLoop();
     /* Initialize the timer */
     void initTimer(int connfd, sockaddr_in clientAddress);
-    /* Adjust the timer */
-    void adjustTimer(HeapTimer* timer);
+    /* Adjust the timer, a connection waiting for its next request gets the idle timeout instead */
+    void adjustTimer(HeapTimer* timer, bool idle = false);
     /* Handle timer events */
     void dealTimer(HeapTimer* timer, int sockfd);
     /* Handle client data */
@@ -51,6 +58,8 @@ public:
     void dealWithRead(int sockfd);
     /* Handle write events */
     void dealWithWrite(int sockfd);
+    /* Hand connections whose filesystem work is done back to the thread pool */
+    void dealWithFileIo();
     /* Set up daemon process */
     int initDaemon();
 
@@ -58,6 +67,30 @@ public:
     int m_port;
     char* m_root;
     int m_logWrite;
+    /* Flight-recorder ring size in KB */
+    int m_logRing;
+    /* Number of rotated log files kept */
+    int m_logKeep;
+    /* Log size limit in MB */
+    int m_logSplitMB;
+    /* Log age limit in seconds */
+    int m_logSplitSeconds;
+    /* Request header and body limits in KB */
+    int m_maxHeaderKB;
+    int m_maxBodyKB;
+    /* Requests per connection and idle timeout in seconds of persistent connections */
+    int m_maxRequests;
+    int m_idleTimeout;
+    /* Size in MB of the compressed-variant cache */
+    int m_compressCacheMB;
+    /* Path of the asset bundle, empty when none is served */
+    string m_assetBundle;
+    /* Workers send the responses they build */
+    int m_writeThrough;
+    /* Connections are registered once and held by one thread at a time */
+    int m_singleOwner;
+    /* The event loop answers static requests itself */
+    int m_inlineStatic;
     int m_closeLog;
     ActorModel m_actormodel;
 
@@ -75,10 +108,15 @@ public:
     /* Thread pool related */
     Threadpool<HttpConn>* m_pool;
     int m_threadNum;
+    /* File I/O pool, null when the workers do the filesystem work themselves */
+    FileIoPool<HttpConn>* m_ioPool;
+    int m_ioThreads;
 
     /* epoll related */
     epoll_event events[MAX_EVENT_NUMBER];
     int m_listenfd;
+    /* The last accept round stopped at its budget, connections are still queued on the listening socket */
+    bool m_acceptPending;
     int m_optLinger;
     int m_triggerMode;
     TriggerMode m_lfdMode;
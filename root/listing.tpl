@@ -0,0 +1,11 @@
+<!DOCTYPE html>
+<html>
+
+<head>
+    <meta charset="UTF-8">
+    <title>Index of {{path}}</title>
+</head>
+
+<body>
+    <h1>Index of {{path}}</h1>{{#entries}}<li><a href="{{href}}">{{name}}</a></li>
+{{/entries}}</body></html>
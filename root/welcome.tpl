@@ -0,0 +1,34 @@
+<!DOCTYPE html>
+
+<head>
+    <meta charset="UTF-8">
+    <title>WebServer</title>
+    <link rel="stylesheet" type="text/css" href="log.css" />
+</head>
+
+<body>
+    <div id="login">
+        <h1>Hello {{user}}, make a choice</h1>
+        <form action="/picture.html" method="POST">
+            <button class="but" type="submit">Picture</button>
+        </form>
+        <br />
+        <form action="/gif.html" method="POST">
+            <button class=but4 type="submit">Gif</button>
+        </form>
+        <br />
+        <form action="/video.html" method="POST">
+            <button class="but1" type="submit">Video</button>
+        </form>
+        <br />
+        <form action="musiclist.cgi" method="POST">
+            <button class="but3" type="submit">Music</button>
+        </form>
+        <br />
+        <form action="/index.html" method="POST">
+            <button class="but2" type="submit">UMass ECE</button>
+        </form>
+    </div>
+</body>
+
+</html>
\ No newline at end of file
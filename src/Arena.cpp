@@ -0,0 +1,84 @@
+#include <stdint.h>
+#include <string.h>
+#include "Arena.h"
+#include "BufferPool.h"
+using namespace std;
+
+atomic<size_t> Arena::m_totalRequests(0);
+atomic<size_t> Arena::m_totalAllocations(0);
+atomic<size_t> Arena::m_totalBytes(0);
+atomic<size_t> Arena::m_totalExtraBlocks(0);
+
+Arena::Arena(): m_blocks(nullptr), m_cur(nullptr), m_end(nullptr), m_allocations(0), m_bytes(0), m_blockCount(0)
+{
+}
+
+Arena::~Arena()
+{
+	reset();
+}
+
+void Arena::grow(size_t size)
+{
+	size_t capacity = size > BLOCK_SIZE / 2 ? sizeof(Block) + size : BLOCK_SIZE;
+	char* buf = BufferPool::getInstance()->acquire(capacity);
+	Block* block = (Block*)buf;
+	block->next = m_blocks;
+	block->size = capacity;
+	m_blocks = block;
+	m_blockCount++;
+	m_cur = buf + sizeof(Block);
+	m_end = buf + capacity;
+}
+
+void* Arena::allocate(size_t size, size_t align)
+{
+	uintptr_t p = ((uintptr_t)m_cur + align - 1) & ~(uintptr_t)(align - 1);
+	if (m_cur == nullptr || p + size > (uintptr_t)m_end) {
+		grow(size + align);
+		p = ((uintptr_t)m_cur + align - 1) & ~(uintptr_t)(align - 1);
+	}
+	m_cur = (char*)(p + size);
+	m_allocations++;
+	m_bytes += size;
+	return (void*)p;
+}
+
+char* Arena::copy(const char* text, size_t len)
+{
+	char* dest = (char*)allocate(len + 1, 1);
+	memcpy(dest, text, len);
+	dest[len] = '\0';
+	return dest;
+}
+
+void Arena::reset()
+{
+	if (m_blocks == nullptr) {
+		return;
+	}
+	m_totalRequests++;
+	m_totalAllocations += m_allocations;
+	m_totalBytes += m_bytes;
+	m_totalExtraBlocks += m_blockCount - 1;
+	while (m_blocks != nullptr) {
+		Block* next = m_blocks->next;
+		BufferPool::getInstance()->release((char*)m_blocks, m_blocks->size);
+		m_blocks = next;
+	}
+	m_cur = nullptr;
+	m_end = nullptr;
+	m_allocations = 0;
+	m_bytes = 0;
+	m_blockCount = 0;
+}
+
+ArenaStats Arena::stats()
+{
+	ArenaStats stats;
+	stats.requests = m_totalRequests;
+	stats.allocations = m_totalAllocations;
+	stats.bytes = m_totalBytes;
+	stats.extraBlocks = m_totalExtraBlocks;
+	return stats;
+}
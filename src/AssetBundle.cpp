@@ -0,0 +1,404 @@
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "AssetBundle.h"
+using namespace std;
+
+/* FNV-1a, 64 bits */
+static uint64_t fnv1a(const char* data, size_t len)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < len; ++i) {
+		hash ^= (unsigned char)data[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static uint64_t alignUp(uint64_t offset)
+{
+	return (offset + AssetBundle::BUNDLE_ALIGN - 1) & ~(uint64_t)(AssetBundle::BUNDLE_ALIGN - 1);
+}
+
+static bool writeAll(int fd, const char* data, size_t len, uint64_t offset)
+{
+	while (len > 0) {
+		ssize_t n = pwrite(fd, data, len, offset);
+		if (n <= 0) {
+			return false;
+		}
+		data += n;
+		len -= n;
+		offset += n;
+	}
+	return true;
+}
+
+/* A file to pack, and its variants until they are written */
+struct PackItem
+{
+	/* URL path and file path */
+	string url;
+	string file;
+	off_t size;
+	uint64_t etag;
+	/* Compressed bodies, indexed by ContentEncoding, empty if the coding does not shrink the file */
+	string compressed[3];
+};
+
+/* Collect the readable regular files under dir, hidden entries are skipped */
+static void collectFiles(const string& dir, const string& url, vector<PackItem>& items)
+{
+	DIR* handle = opendir(dir.c_str());
+	if (handle == nullptr) {
+		return;
+	}
+	struct dirent* entry;
+	while ((entry = readdir(handle)) != nullptr) {
+		if (entry->d_name[0] == '.') {
+			continue;
+		}
+		string file = dir + "/" + entry->d_name;
+		struct stat st;
+		if (stat(file.c_str(), &st) == -1 || !(st.st_mode & S_IROTH)) {
+			continue;
+		}
+		if (S_ISDIR(st.st_mode)) {
+			collectFiles(file, url + "/" + entry->d_name, items);
+		}
+		else if (S_ISREG(st.st_mode) && st.st_size <= AssetBundle::MAX_FILE_SIZE) {
+			PackItem item;
+			item.url = url + "/" + entry->d_name;
+			item.file = file;
+			item.size = st.st_size;
+			items.push_back(item);
+		}
+	}
+	closedir(handle);
+}
+
+/* Append a string to the string area, returning its file offset */
+static uint64_t addString(string& strings, uint64_t base, const string& value)
+{
+	uint64_t offset = base + strings.size();
+	strings += value;
+	return offset;
+}
+
+AssetBundle::AssetBundle(): m_base(nullptr), m_size(0), m_header(nullptr), m_entries(nullptr), m_slots(nullptr)
+{
+}
+
+AssetBundle::~AssetBundle()
+{
+	if (m_base != nullptr) {
+		munmap(m_base, m_size);
+	}
+}
+
+uint64_t AssetBundle::hashPath(const char* path, size_t len)
+{
+	return fnv1a(path, len);
+}
+
+int AssetBundle::pack(const char* root, const char* path)
+{
+	vector<PackItem> items;
+	collectFiles(root, "", items);
+	sort(items.begin(), items.end(), [](const PackItem& a, const PackItem& b) { return a.url < b.url; });
+
+	/* Hash the contents for the ETags and compress the text files */
+	for (size_t i = 0; i < items.size(); ++i) {
+		string raw;
+		if (!CompressCache::readFile(items[i].file.c_str(), items[i].size, raw)) {
+			return -1;
+		}
+		items[i].etag = fnv1a(raw.data(), raw.size());
+		if (!CompressCache::isCompressible(items[i].url.c_str()) || items[i].size < CompressCache::MIN_FILE_SIZE) {
+			continue;
+		}
+		for (int encoding = ENCODING_GZIP; encoding <= ENCODING_BROTLI; ++encoding) {
+			string& out = items[i].compressed[encoding];
+			if (!CompressCache::compress(raw, (ContentEncoding)encoding, out, true) || out.size() >= raw.size()) {
+				out.clear();
+			}
+		}
+	}
+
+	/* Lay out the entries, the hash index and the strings, then the blobs */
+	uint32_t count = items.size();
+	uint32_t slotCount = 16;
+	while (slotCount < count * 2) {
+		slotCount <<= 1;
+	}
+	BundleHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = ASSET_BUNDLE_MAGIC;
+	header.version = ASSET_BUNDLE_VERSION;
+	header.count = count;
+	header.slotCount = slotCount;
+	header.entriesOffset = sizeof(BundleHeader);
+	header.slotsOffset = header.entriesOffset + (uint64_t)count * sizeof(BundleEntry);
+	uint64_t stringsOffset = header.slotsOffset + (uint64_t)slotCount * sizeof(uint32_t);
+
+	vector<BundleEntry> entries(count);
+	vector<uint32_t> slots(slotCount, 0);
+	string strings;
+	/* Blob offsets are only known once the string area is complete */
+	vector<uint64_t> lengths(count * 3, 0);
+	for (uint32_t i = 0; i < count; ++i) {
+		PackItem& item = items[i];
+		BundleEntry& entry = entries[i];
+		memset(&entry, 0, sizeof(entry));
+		entry.hash = fnv1a(item.url.data(), item.url.size());
+		entry.pathOffset = addString(strings, stringsOffset, item.url);
+		entry.pathLen = item.url.size();
+		entry.vary = !item.compressed[ENCODING_GZIP].empty() || !item.compressed[ENCODING_BROTLI].empty();
+		for (int encoding = ENCODING_IDENTITY; encoding <= ENCODING_BROTLI; ++encoding) {
+			uint64_t length = encoding == ENCODING_IDENTITY ? item.size : item.compressed[encoding].size();
+			if (encoding != ENCODING_IDENTITY && length == 0) {
+				continue;
+			}
+			BundleVariant& variant = entry.variants[encoding];
+			char etag[32];
+			snprintf(etag, sizeof(etag), "\"%016llx%s\"", (unsigned long long)item.etag,
+					 encoding == ENCODING_IDENTITY ? "" : (encoding == ENCODING_GZIP ? "-gz" : "-br"));
+			char head[256];
+			int n = snprintf(head, sizeof(head), "Content-Length: %llu\r\nETag: %s\r\n", (unsigned long long)length, etag);
+			if (encoding != ENCODING_IDENTITY) {
+				n += snprintf(head + n, sizeof(head) - n, "Content-Encoding: %s\r\n",
+							  CompressCache::encodingName((ContentEncoding)encoding));
+			}
+			if (entry.vary) {
+				n += snprintf(head + n, sizeof(head) - n, "Vary: Accept-Encoding\r\n");
+			}
+			variant.length = length;
+			variant.etagOffset = addString(strings, stringsOffset, etag);
+			variant.etagLen = strlen(etag);
+			variant.headOffset = addString(strings, stringsOffset, string(head, n));
+			variant.headLen = n;
+			lengths[i * 3 + encoding] = length;
+		}
+		uint32_t slot = entry.hash & (slotCount - 1);
+		while (slots[slot] != 0) {
+			slot = (slot + 1) & (slotCount - 1);
+		}
+		slots[slot] = i + 1;
+	}
+	uint64_t cursor = alignUp(stringsOffset + strings.size());
+	for (uint32_t i = 0; i < count; ++i) {
+		for (int encoding = ENCODING_IDENTITY; encoding <= ENCODING_BROTLI; ++encoding) {
+			if (lengths[i * 3 + encoding] == 0) {
+				continue;
+			}
+			entries[i].variants[encoding].offset = cursor;
+			cursor = alignUp(cursor + lengths[i * 3 + encoding]);
+		}
+	}
+	header.size = cursor;
+
+	string tmp = string(path) + ".tmp";
+	int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		return -1;
+	}
+	string meta((const char*)&header, sizeof(header));
+	meta.append((const char*)entries.data(), (size_t)count * sizeof(BundleEntry));
+	meta.append((const char*)slots.data(), (size_t)slotCount * sizeof(uint32_t));
+	meta += strings;
+	bool ok = writeAll(fd, meta.data(), meta.size(), 0);
+	for (uint32_t i = 0; ok && i < count; ++i) {
+		const BundleVariant* variants = entries[i].variants;
+		string raw;
+		ok = CompressCache::readFile(items[i].file.c_str(), items[i].size, raw)
+			 && writeAll(fd, raw.data(), raw.size(), variants[ENCODING_IDENTITY].offset);
+		for (int encoding = ENCODING_GZIP; ok && encoding <= ENCODING_BROTLI; ++encoding) {
+			const string& body = items[i].compressed[encoding];
+			ok = writeAll(fd, body.data(), body.size(), variants[encoding].offset);
+		}
+	}
+	ok = ok && ftruncate(fd, header.size) == 0 && fsync(fd) == 0;
+	close(fd);
+	if (!ok || rename(tmp.c_str(), path) == -1) {
+		unlink(tmp.c_str());
+		return -1;
+	}
+	return count;
+}
+
+shared_ptr<AssetBundle> AssetBundle::load(const char* path, bool warm)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		return nullptr;
+	}
+	shared_ptr<AssetBundle> bundle(new AssetBundle());
+	if (fstat(fd, &bundle->m_stat) == -1 || (size_t)bundle->m_stat.st_size < sizeof(BundleHeader)) {
+		close(fd);
+		return nullptr;
+	}
+	bundle->m_size = bundle->m_stat.st_size;
+	void* base = mmap(nullptr, bundle->m_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		return nullptr;
+	}
+	bundle->m_base = (char*)base;
+	bundle->m_header = (const BundleHeader*)base;
+	if (!bundle->check()) {
+		return nullptr;
+	}
+	bundle->m_entries = (const BundleEntry*)(bundle->m_base + bundle->m_header->entriesOffset);
+	bundle->m_slots = (const uint32_t*)(bundle->m_base + bundle->m_header->slotsOffset);
+	/* Huge pages where the kernel backs file mappings with them, ignored elsewhere */
+	madvise(base, bundle->m_size, MADV_HUGEPAGE);
+	if (warm) {
+		/* Fault every page in now, so no request ever waits for the disk */
+		madvise(base, bundle->m_size, MADV_WILLNEED);
+		long page = sysconf(_SC_PAGESIZE);
+		volatile char sink = 0;
+		for (size_t offset = 0; offset < bundle->m_size; offset += page) {
+			sink += bundle->m_base[offset];
+		}
+		(void)sink;
+	}
+	return bundle;
+}
+
+bool AssetBundle::check() const
+{
+	const BundleHeader* header = m_header;
+	if (header->magic != ASSET_BUNDLE_MAGIC || header->version != ASSET_BUNDLE_VERSION || header->size != m_size) {
+		return false;
+	}
+	if (header->slotCount == 0 || (header->slotCount & (header->slotCount - 1)) != 0
+		|| header->slotCount < header->count || header->entriesOffset % 8 != 0 || header->slotsOffset % 4 != 0
+		|| header->entriesOffset + (uint64_t)header->count * sizeof(BundleEntry) > m_size
+		|| header->slotsOffset + (uint64_t)header->slotCount * sizeof(uint32_t) > m_size) {
+		return false;
+	}
+	const BundleEntry* entries = (const BundleEntry*)(m_base + header->entriesOffset);
+	for (uint32_t i = 0; i < header->count; ++i) {
+		if (entries[i].pathOffset + entries[i].pathLen > m_size) {
+			return false;
+		}
+		for (int encoding = ENCODING_IDENTITY; encoding <= ENCODING_BROTLI; ++encoding) {
+			const BundleVariant& variant = entries[i].variants[encoding];
+			if (variant.offset + variant.length > m_size || variant.headOffset + variant.headLen > m_size
+				|| variant.etagOffset + variant.etagLen > m_size) {
+				return false;
+			}
+		}
+	}
+	const uint32_t* slots = (const uint32_t*)(m_base + header->slotsOffset);
+	for (uint32_t i = 0; i < header->slotCount; ++i) {
+		if (slots[i] > header->count) {
+			return false;
+		}
+	}
+	return true;
+}
+
+const BundleEntry* AssetBundle::find(const char* path, size_t len) const
+{
+	uint64_t hash = fnv1a(path, len);
+	uint32_t mask = m_header->slotCount - 1;
+	/* At most half the slots are used, so a free slot ends every probe */
+	for (uint32_t slot = hash & mask; m_slots[slot] != 0; slot = (slot + 1) & mask) {
+		const BundleEntry* entry = m_entries + m_slots[slot] - 1;
+		if (entry->hash == hash && entry->pathLen == len && memcmp(m_base + entry->pathOffset, path, len) == 0) {
+			return entry;
+		}
+	}
+	return nullptr;
+}
+
+/* Whether two stat results describe the same version of a file */
+static bool sameVersion(const struct stat& a, const struct stat& b)
+{
+	return a.st_dev == b.st_dev && a.st_ino == b.st_ino && a.st_size == b.st_size
+		   && a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+}
+
+bool AssetBundle::sameFile(const struct stat& st) const
+{
+	return sameVersion(st, m_stat);
+}
+
+AssetStore* AssetStore::getInstance()
+{
+	static AssetStore instance;
+	return &instance;
+}
+
+bool AssetStore::init(const char* path, const char* root)
+{
+	m_path = path;
+	struct stat st;
+	if (stat(path, &st) == -1 && AssetBundle::pack(root, path) < 0) {
+		return false;
+	}
+	shared_ptr<const AssetBundle> bundle = AssetBundle::load(path, true);
+	if (!bundle) {
+		return false;
+	}
+	atomic_store(&m_current, bundle);
+	return true;
+}
+
+shared_ptr<const AssetBundle> AssetStore::current()
+{
+	return atomic_load(&m_current);
+}
+
+void* AssetStore::loadThread(void* arg)
+{
+	AssetStore* store = (AssetStore*)arg;
+	/* Checking every entry and touching every page reads the whole file, which is why it happens here */
+	shared_ptr<const AssetBundle> bundle = AssetBundle::load(store->m_path.c_str(), true);
+	if (bundle) {
+		atomic_store(&store->m_loaded, bundle);
+	}
+	/* A malformed replacement is ignored, the old bundle stays in service */
+	else {
+		store->m_rejected = store->m_candidate;
+	}
+	store->m_loading.store(false, memory_order_release);
+	return nullptr;
+}
+
+bool AssetStore::refresh()
+{
+	/* Only the swap happens on the event loop */
+	shared_ptr<const AssetBundle> loaded = atomic_load(&m_loaded);
+	if (loaded) {
+		atomic_store(&m_loaded, shared_ptr<const AssetBundle>());
+		atomic_store(&m_current, loaded);
+		return true;
+	}
+	struct stat st;
+	if (m_path.empty() || m_loading.load(memory_order_acquire) || stat(m_path.c_str(), &st) == -1) {
+		return false;
+	}
+	shared_ptr<const AssetBundle> current = atomic_load(&m_current);
+	if ((current && current->sameFile(st)) || sameVersion(st, m_rejected)) {
+		return false;
+	}
+	m_candidate = st;
+	m_loading.store(true, memory_order_relaxed);
+	pthread_t tid;
+	if (pthread_create(&tid, nullptr, loadThread, this) != 0) {
+		m_loading.store(false, memory_order_relaxed);
+		return false;
+	}
+	pthread_detach(tid);
+	return false;
+}
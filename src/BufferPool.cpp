@@ -0,0 +1,117 @@
+#include "BufferPool.h"
+using namespace std;
+
+/* Each slab is carved into buffers of one class, at least four buffers per slab */
+static constexpr size_t SLAB_SIZE = 64 * 1024;
+
+BufferPool* BufferPool::getInstance()
+{
+	static BufferPool instance;
+	return &instance;
+}
+
+BufferPool::BufferPool(): m_bytesPeak(0)
+{
+	for (int i = 0; i < CLASS_NUM; ++i) {
+		m_classes[i].freeList = nullptr;
+		m_classes[i].total = 0;
+		m_classes[i].inUse = 0;
+	}
+}
+
+BufferPool::~BufferPool()
+{
+	for (int i = 0; i < CLASS_NUM; ++i) {
+		for (size_t j = 0; j < m_classes[i].slabs.size(); ++j) {
+			delete [] m_classes[i].slabs[j];
+		}
+	}
+}
+
+int BufferPool::classOf(size_t size)
+{
+	for (int i = 0; i < CLASS_NUM; ++i) {
+		if (size <= ((size_t)1 << (MIN_SHIFT + i))) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+char* BufferPool::acquire(size_t& size)
+{
+	int index = classOf(size);
+	if (index < 0) {
+		/* Round up to a power of two so a buffer grown by doubling is not reallocated on every step */
+		size_t bufSize = MAX_BUFFER_SIZE;
+		while (bufSize < size) {
+			bufSize <<= 1;
+		}
+		size = bufSize;
+		return new char[bufSize];
+	}
+	size_t bufSize = (size_t)1 << (MIN_SHIFT + index);
+	SizeClass& cls = m_classes[index];
+
+	cls.lock.lock();
+	if (cls.freeList == nullptr) {
+		size_t slabSize = SLAB_SIZE > 4 * bufSize ? SLAB_SIZE : 4 * bufSize;
+		char* slab = new char[slabSize];
+		cls.slabs.push_back(slab);
+		for (size_t off = 0; off < slabSize; off += bufSize) {
+			FreeBuffer* fb = (FreeBuffer*)(slab + off);
+			fb->next = cls.freeList;
+			cls.freeList = fb;
+			cls.total++;
+		}
+	}
+	FreeBuffer* fb = cls.freeList;
+	cls.freeList = fb->next;
+	cls.inUse++;
+	cls.lock.unlock();
+
+	size = bufSize;
+	return (char*)fb;
+}
+
+void BufferPool::release(char* buf, size_t size)
+{
+	if (buf == nullptr) {
+		return;
+	}
+	int index = classOf(size);
+	if (index < 0) {
+		delete [] buf;
+		return;
+	}
+	SizeClass& cls = m_classes[index];
+	FreeBuffer* fb = (FreeBuffer*)buf;
+
+	cls.lock.lock();
+	fb->next = cls.freeList;
+	cls.freeList = fb;
+	cls.inUse--;
+	cls.lock.unlock();
+}
+
+BufferPoolStats BufferPool::stats()
+{
+	BufferPoolStats s = { 0, 0, 0, 0 };
+	for (int i = 0; i < CLASS_NUM; ++i) {
+		size_t bufSize = (size_t)1 << (MIN_SHIFT + i);
+		SizeClass& cls = m_classes[i];
+		cls.lock.lock();
+		s.bytesInUse += cls.inUse * bufSize;
+		s.bytesTotal += cls.total * bufSize;
+		s.buffersInUse += cls.inUse;
+		cls.lock.unlock();
+	}
+	/* The peak is sampled here rather than on every acquire to keep the fast path short */
+	m_statLock.lock();
+	if (s.bytesInUse > m_bytesPeak) {
+		m_bytesPeak = s.bytesInUse;
+	}
+	s.bytesPeak = m_bytesPeak;
+	m_statLock.unlock();
+	return s;
+}
@@ -0,0 +1,113 @@
+#include <cstdio>
+#include <cstring>
+#include "ChainBuffer.h"
+using namespace std;
+
+ChainBuffer::ChainBuffer(size_t chunkSize): m_chunkSize(chunkSize), m_size(0)
+{
+}
+
+ChainBuffer::~ChainBuffer()
+{
+	clear();
+}
+
+ChainBuffer::Chunk& ChainBuffer::tail(size_t len)
+{
+	if (m_chunks.empty() || m_chunks.back().capacity - m_chunks.back().used < len) {
+		Chunk chunk;
+		chunk.capacity = len > m_chunkSize ? len : m_chunkSize;
+		chunk.data = BufferPool::getInstance()->acquire(chunk.capacity);
+		chunk.used = 0;
+		m_chunks.push_back(chunk);
+	}
+	return m_chunks.back();
+}
+
+void ChainBuffer::append(const char* data, size_t len)
+{
+	m_size += len;
+	/* Top up the last chunk first, the rest goes into one new chunk */
+	if (!m_chunks.empty()) {
+		Chunk& last = m_chunks.back();
+		size_t n = last.capacity - last.used < len ? last.capacity - last.used : len;
+		memcpy(last.data + last.used, data, n);
+		last.used += n;
+		data += n;
+		len -= n;
+	}
+	if (len > 0) {
+		Chunk& chunk = tail(len);
+		memcpy(chunk.data + chunk.used, data, len);
+		chunk.used += len;
+	}
+}
+
+const char* ChainBuffer::appendf(const char* format, va_list args)
+{
+	va_list retry;
+	va_copy(retry, args);
+	Chunk* chunk = &tail(1);
+	size_t room = chunk->capacity - chunk->used;
+	int len = vsnprintf(chunk->data + chunk->used, room, format, args);
+	if (len < 0) {
+		len = 0;
+	}
+	/* The text must stay contiguous, format it again into a chunk large enough to hold it */
+	else if ((size_t)len >= room) {
+		chunk = &tail(len + 1);
+		vsnprintf(chunk->data + chunk->used, len + 1, format, retry);
+	}
+	va_end(retry);
+	char* text = chunk->data + chunk->used;
+	chunk->used += len;
+	m_size += len;
+	return text;
+}
+
+char* ChainBuffer::prepare(size_t len)
+{
+	Chunk& chunk = tail(len);
+	return chunk.data + chunk.used;
+}
+
+void ChainBuffer::commit(size_t len)
+{
+	m_chunks.back().used += len;
+	m_size += len;
+}
+
+void ChainBuffer::fill(size_t offset, size_t len, vector<iovec>& iov) const
+{
+	size_t start = 0;
+	for (size_t i = 0; i < m_chunks.size() && len > 0; ++i) {
+		const Chunk& chunk = m_chunks[i];
+		if (offset >= start + chunk.used) {
+			start += chunk.used;
+			continue;
+		}
+		size_t skip = offset - start;
+		size_t n = chunk.used - skip < len ? chunk.used - skip : len;
+		char* base = chunk.data + skip;
+		if (!iov.empty() && (char*)iov.back().iov_base + iov.back().iov_len == base) {
+			iov.back().iov_len += n;
+		}
+		else {
+			iovec entry = { base, n };
+			iov.push_back(entry);
+		}
+		offset += n;
+		len -= n;
+		start += chunk.used;
+	}
+}
+
+void ChainBuffer::clear()
+{
+	BufferPool* pool = BufferPool::getInstance();
+	for (size_t i = 0; i < m_chunks.size(); ++i) {
+		pool->release(m_chunks[i].data, m_chunks[i].capacity);
+	}
+	m_chunks.clear();
+	m_size = 0;
+}
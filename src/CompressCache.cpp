@@ -0,0 +1,187 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+#include <brotli/encode.h>
+#include "CompressCache.h"
+using namespace std;
+
+CompressCache* CompressCache::getInstance()
+{
+	static CompressCache instance;
+	return &instance;
+}
+
+CompressCache::CompressCache(): m_bytes(0), m_maxBytes(0), m_hits(0), m_misses(0)
+{
+}
+
+void CompressCache::init(size_t maxBytes)
+{
+	m_lock.lock();
+	m_maxBytes = maxBytes;
+	m_lock.unlock();
+}
+
+const char* CompressCache::encodingName(ContentEncoding encoding)
+{
+	return encoding == ENCODING_BROTLI ? "br" : "gzip";
+}
+
+const char* CompressCache::encodingSuffix(ContentEncoding encoding)
+{
+	return encoding == ENCODING_BROTLI ? ".br" : ".gz";
+}
+
+bool CompressCache::isCompressible(const char* path)
+{
+	static const char* const EXTENSIONS[] = { ".html", ".htm", ".css", ".js", ".json", ".txt", ".xml", ".svg", ".csv" };
+	const char* dot = strrchr(path, '.');
+	if (dot == nullptr || strchr(dot, '/') != nullptr) {
+		return false;
+	}
+	for (size_t i = 0; i < sizeof(EXTENSIONS) / sizeof(EXTENSIONS[0]); ++i) {
+		if (strcasecmp(dot, EXTENSIONS[i]) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool CompressCache::readFile(const char* path, size_t size, string& out)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		return false;
+	}
+	out.resize(size);
+	size_t done = 0;
+	while (done < size) {
+		ssize_t n = pread(fd, &out[done], size - done, done);
+		if (n <= 0) {
+			break;
+		}
+		done += n;
+	}
+	close(fd);
+	return done == size;
+}
+
+bool CompressCache::compress(const string& in, ContentEncoding encoding, string& out, bool dense)
+{
+	if (encoding == ENCODING_BROTLI) {
+		size_t len = BrotliEncoderMaxCompressedSize(in.size());
+		if (len == 0) {
+			return false;
+		}
+		out.resize(len);
+		if (!BrotliEncoderCompress(dense ? BROTLI_MAX_QUALITY : REQUEST_BROTLI_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, in.size(),
+								   (const uint8_t*)in.data(), &len, (uint8_t*)&out[0])) {
+			return false;
+		}
+		out.resize(len);
+		return true;
+	}
+	z_stream stream;
+	stream.zalloc = Z_NULL;
+	stream.zfree = Z_NULL;
+	stream.opaque = Z_NULL;
+	/* 16 added to the window bits selects the gzip wrapper */
+	if (deflateInit2(&stream, dense ? Z_BEST_COMPRESSION : REQUEST_GZIP_LEVEL, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+		return false;
+	}
+	out.resize(deflateBound(&stream, in.size()));
+	stream.next_in = (Bytef*)in.data();
+	stream.avail_in = in.size();
+	stream.next_out = (Bytef*)&out[0];
+	stream.avail_out = out.size();
+	int ret = deflate(&stream, Z_FINISH);
+	out.resize(stream.total_out);
+	deflateEnd(&stream);
+	return ret == Z_STREAM_END;
+}
+
+shared_ptr<const string> CompressCache::get(const char* path, const struct stat& st, ContentEncoding encoding)
+{
+	if (st.st_size < MIN_FILE_SIZE || st.st_size > MAX_FILE_SIZE) {
+		return nullptr;
+	}
+	string key(path);
+	key.push_back('\0');
+	key.append(encodingName(encoding));
+
+	m_lock.lock();
+	if (m_maxBytes == 0) {
+		m_lock.unlock();
+		return nullptr;
+	}
+	auto it = m_index.find(key);
+	if (it != m_index.end()) {
+		Entry& entry = *it->second;
+		if (entry.mtime.tv_sec == st.st_mtim.tv_sec && entry.mtime.tv_nsec == st.st_mtim.tv_nsec
+			&& entry.size == st.st_size) {
+			m_lru.splice(m_lru.begin(), m_lru, it->second);
+			m_hits++;
+			shared_ptr<const string> data = entry.data;
+			m_lock.unlock();
+			return data;
+		}
+		/* The file changed since it was compressed */
+		m_bytes -= entry.key.size() + (entry.data ? entry.data->size() : 0);
+		m_lru.erase(it->second);
+		m_index.erase(it);
+	}
+	m_misses++;
+	/* Another thread is compressing this variant, the response goes out without it instead of waiting */
+	if (!m_inFlight.insert(key).second) {
+		m_lock.unlock();
+		return nullptr;
+	}
+	m_lock.unlock();
+
+	/* Compress without the lock */
+	string raw;
+	shared_ptr<string> compressed;
+	bool read = readFile(path, st.st_size, raw);
+	if (read) {
+		compressed = make_shared<string>();
+		if (!compress(raw, encoding, *compressed, false) || compressed->size() >= raw.size()) {
+			compressed.reset();
+		}
+	}
+
+	m_lock.lock();
+	m_inFlight.erase(key);
+	/* A file that could not be read is not remembered, the next request tries again */
+	if (read && m_index.find(key) == m_index.end()) {
+		Entry entry;
+		entry.key = key;
+		entry.mtime = st.st_mtim;
+		entry.size = st.st_size;
+		entry.data = compressed;
+		m_lru.push_front(entry);
+		m_index[key] = m_lru.begin();
+		m_bytes += key.size() + (compressed ? compressed->size() : 0);
+		while (m_bytes > m_maxBytes && !m_lru.empty()) {
+			Entry& last = m_lru.back();
+			m_bytes -= last.key.size() + (last.data ? last.data->size() : 0);
+			m_index.erase(last.key);
+			m_lru.pop_back();
+		}
+	}
+	m_lock.unlock();
+	return compressed;
+}
+
+CompressCacheStats CompressCache::stats()
+{
+	CompressCacheStats stats;
+	m_lock.lock();
+	stats.entries = m_lru.size();
+	stats.bytes = m_bytes;
+	stats.hits = m_hits;
+	stats.misses = m_misses;
+	m_lock.unlock();
+	return stats;
+}
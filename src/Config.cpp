@@ -8,6 +8,32 @@ Config::Config()
 	port = 9007;
 	/* Log write mode, default is synchronous */
 	logWrite = 0;
+	/* Flight-recorder ring size, default is disabled */
+	logRing = 0;
+	/* Rotated log files kept on disk, default is 7 */
+	logKeep = 7;
+	/* Log size limit, default is no limit */
+	logSplitMB = 0;
+	/* Log age limit, default is no limit */
+	logSplitSeconds = 0;
+	/* Request header limit, default is 8 KB */
+	maxHeaderKB = 8;
+	/* Request body limit, default is 1 MB */
+	maxBodyKB = 1024;
+	/* Requests per persistent connection, default is 1000 */
+	maxRequests = 1000;
+	/* Idle persistent connections are closed after 15 seconds by default */
+	idleTimeout = 15;
+	/* Two threads do the filesystem work by default */
+	ioThreads = 2;
+	/* Compressed variants of text files are kept up to 32MB by default */
+	compressCacheMB = 32;
+	/* Responses are written as soon as they are built by default */
+	writeThrough = 1;
+	/* Edge-triggered connections are registered once for their lifetime by default */
+	singleOwner = 1;
+	/* Static requests skip the thread pool by default */
+	inlineStatic = 1;
 	/* Trigger combination mode, default is listenfd ET + connfd ET */
 	triggerMode = 3;
 	/* listenfd trigger mode, default is LT */
@@ -29,7 +55,7 @@ Config::Config()
 void Config::parseArg(int argc, char* argv[])
 {
 	int opt;
-	const char* str = "p:l:m:o:s:t:c:a:";
+	const char* str = "p:l:m:o:s:t:c:a:f:k:z:j:e:b:n:i:d:g:r:w:u:x:";
 	while ((opt = getopt(argc, argv, str)) != -1) {
 		switch (opt)
 		{
@@ -54,6 +80,48 @@ void Config::parseArg(int argc, char* argv[])
 		case 'c':
 			closeLog = atoi(optarg);
 			break;
+		case 'f':
+			logRing = atoi(optarg);
+			break;
+		case 'k':
+			logKeep = atoi(optarg);
+			break;
+		case 'z':
+			logSplitMB = atoi(optarg);
+			break;
+		case 'j':
+			logSplitSeconds = atoi(optarg);
+			break;
+		case 'e':
+			maxHeaderKB = atoi(optarg);
+			break;
+		case 'b':
+			maxBodyKB = atoi(optarg);
+			break;
+		case 'n':
+			maxRequests = atoi(optarg);
+			break;
+		case 'i':
+			idleTimeout = atoi(optarg);
+			break;
+		case 'd':
+			ioThreads = atoi(optarg);
+			break;
+		case 'g':
+			compressCacheMB = atoi(optarg);
+			break;
+		case 'r':
+			assetBundle = optarg;
+			break;
+		case 'w':
+			writeThrough = atoi(optarg);
+			break;
+		case 'u':
+			singleOwner = atoi(optarg);
+			break;
+		case 'x':
+			inlineStatic = atoi(optarg);
+			break;
 		case 'a':
 		{
 			int tmp = atoi(optarg);	
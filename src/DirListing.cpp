@@ -0,0 +1,174 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include "DirListing.h"
+#include "OpenFileCache.h"
+using namespace std;
+
+/* Strip trailing slashes, "/" becomes empty */
+static string trimSlashes(const char* path)
+{
+	string trimmed(path);
+	while (!trimmed.empty() && trimmed.back() == '/') {
+		trimmed.pop_back();
+	}
+	return trimmed;
+}
+
+DirListingCache* DirListingCache::getInstance()
+{
+	static DirListingCache instance;
+	return &instance;
+}
+
+void DirListingCache::stampOf(const struct stat& st, Stamp& stamp)
+{
+	stamp.ino = st.st_ino;
+	stamp.size = st.st_size;
+	stamp.mtime = st.st_mtim;
+}
+
+bool DirListingCache::sameStamp(const Stamp& a, const Stamp& b)
+{
+	return a.ino == b.ino && a.size == b.size && a.mtime.tv_sec == b.mtime.tv_sec && a.mtime.tv_nsec == b.mtime.tv_nsec;
+}
+
+shared_ptr<const string> DirListingCache::get(const char* path, const char* urlPath, Arena& scratch)
+{
+	string dir = trimSlashes(path);
+	string url = trimSlashes(urlPath);
+	/* The directory's mtime changes with every entry added, removed or renamed */
+	shared_ptr<const OpenFile> file = OpenFileCache::getInstance()->lookup(dir.c_str());
+	/* A changed template is a new object */
+	shared_ptr<const Template> listing = TemplateStore::getInstance()->get("listing");
+	if (file->error != 0 || !S_ISDIR(file->st.st_mode) || !listing) {
+		return nullptr;
+	}
+	Stamp stamp;
+	stampOf(file->st, stamp);
+	string key = dir;
+	key.push_back('\0');
+	key += url;
+
+	m_lock.lock();
+	auto it = m_index.find(key);
+	if (it != m_index.end()) {
+		const Entry& entry = *it->second;
+		if (sameStamp(entry.stamp, stamp) && entry.listing == listing) {
+			m_lru.splice(m_lru.begin(), m_lru, it->second);
+			shared_ptr<const string> page = entry.page;
+			m_lock.unlock();
+			return page;
+		}
+		m_lru.erase(it->second);
+		m_index.erase(it);
+	}
+	m_lock.unlock();
+
+	/* Build without the lock, two threads listing a changed directory at once both do the work */
+	shared_ptr<string> page = make_shared<string>();
+	if (!render(dir, url, *listing, scratch, *page)) {
+		return nullptr;
+	}
+
+	m_lock.lock();
+	if (m_index.find(key) == m_index.end()) {
+		Entry entry;
+		entry.key = key;
+		entry.stamp = stamp;
+		entry.listing = listing;
+		entry.page = page;
+		m_lru.push_front(entry);
+		m_index[key] = m_lru.begin();
+		if (m_lru.size() > MAX_ENTRIES) {
+			m_index.erase(m_lru.back().key);
+			m_lru.pop_back();
+		}
+	}
+	m_lock.unlock();
+	return page;
+}
+
+/* Order of alphasort() */
+static bool nameBefore(const char* a, const char* b)
+{
+	return strcoll(a, b) < 0;
+}
+
+bool DirListingCache::render(const string& path, const string& urlPath, const Template& page, Arena& scratch,
+							 string& out)
+{
+	DIR* handle = opendir(path.c_str());
+	if (handle == nullptr) {
+		return false;
+	}
+	ArenaAllocator<const char*> alloc(scratch);
+	vector<const char*, ArenaAllocator<const char*>> names(alloc);
+	struct dirent* entry;
+	while ((entry = readdir(handle)) != nullptr) {
+		if (entry->d_name[0] == '.') {
+			continue;
+		}
+		/* Subdirectories end with a slash, in the link and in the text */
+		bool isDir = entry->d_type == DT_DIR;
+		if (entry->d_type == DT_UNKNOWN) {
+			struct stat st;
+			isDir = fstatat(dirfd(handle), entry->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+		}
+		size_t len = strlen(entry->d_name);
+		char* name = (char*)scratch.allocate(len + 2, 1);
+		memcpy(name, entry->d_name, len);
+		name[len] = isDir ? '/' : '\0';
+		name[len + 1] = '\0';
+		names.push_back(name);
+	}
+	closedir(handle);
+	sort(names.begin(), names.end(), nameBefore);
+
+	TemplateValue vars[Template::MAX_NAMES];
+	TemplateRows loops[Template::MAX_NAMES];
+	for (size_t i = 0; i < Template::MAX_NAMES; ++i) {
+		vars[i] = TemplateValue{ "", 0 };
+		loops[i] = TemplateRows{ nullptr, 0, 0 };
+	}
+	const char* title = urlPath.empty() ? "/" : urlPath.c_str();
+	int pathVar = page.variable("path");
+	if (pathVar != -1) {
+		vars[pathVar] = TemplateValue{ title, strlen(title) };
+	}
+	int entries = page.loop("entries");
+	if (entries != -1) {
+		size_t columns = page.columnCount(entries);
+		size_t rows = names.size();
+		TemplateValue* cells = (TemplateValue*)scratch.allocate(rows * columns * sizeof(TemplateValue),
+																alignof(TemplateValue));
+		int href = page.column(entries, "href");
+		int name = page.column(entries, "name");
+		for (size_t r = 0; r < rows; ++r) {
+			for (size_t c = 0; c < columns; ++c) {
+				cells[r * columns + c] = TemplateValue{ "", 0 };
+			}
+			size_t len = strlen(names[r]);
+			if (href != -1) {
+				size_t hrefLen = urlPath.size() + 1 + len;
+				char* link = (char*)scratch.allocate(hrefLen, 1);
+				memcpy(link, urlPath.data(), urlPath.size());
+				link[urlPath.size()] = '/';
+				memcpy(link + urlPath.size() + 1, names[r], len);
+				cells[r * columns + href] = TemplateValue{ link, hrefLen };
+			}
+			if (name != -1) {
+				cells[r * columns + name] = TemplateValue{ names[r], len };
+			}
+		}
+		loops[entries] = TemplateRows{ cells, rows, columns };
+	}
+	out.reserve(page.measure(vars, loops));
+	auto append = [&out](const char* data, size_t len) { out.append(data, len); };
+	page.render(vars, loops, append);
+	return true;
+}
@@ -0,0 +1,109 @@
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "FormParser.h"
+using namespace std;
+
+/* Value of a hexadecimal digit, -1 for any other character */
+static int hexValue(char c)
+{
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+const char* FormParser::find(const char* p, const char* end, char a, char b)
+{
+#ifdef __SSE2__
+	const __m128i va = _mm_set1_epi8(a);
+	const __m128i vb = _mm_set1_epi8(b);
+	for (; end - p >= 16; p += 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i*)p);
+		int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)));
+		if (mask != 0) {
+			return p + __builtin_ctz(mask);
+		}
+	}
+#endif
+	for (; p < end; ++p) {
+		if (*p == a || *p == b) {
+			return p;
+		}
+	}
+	return end;
+}
+
+size_t FormParser::decode(char* data, size_t len)
+{
+	char* end = data + len;
+	char* in = (char*)find(data, end, '%', '+');
+	/* Nothing to decode, the common case */
+	if (in == end) {
+		return len;
+	}
+	char* out = in;
+	while (in < end) {
+		if (*in == '+') {
+			*out++ = ' ';
+			in++;
+		}
+		else if (*in == '%' && end - in >= 3 && hexValue(in[1]) != -1 && hexValue(in[2]) != -1) {
+			*out++ = (char)(hexValue(in[1]) * 16 + hexValue(in[2]));
+			in += 3;
+		}
+		else if (*in == '%') {
+			*out++ = *in++;
+		}
+		else {
+			/* Copy the run up to the next escape */
+			const char* next = find(in, end, '%', '+');
+			memmove(out, in, next - in);
+			out += next - in;
+			in = (char*)next;
+		}
+	}
+	return out - data;
+}
+
+size_t FormParser::parse(char* data, size_t len)
+{
+	m_count = 0;
+	char* end = data + len;
+	char* p = data;
+	while (p < end && m_count < MAX_FIELDS) {
+		char* fieldEnd = (char*)find(p, end, '&', '&');
+		/* Empty fields, as in "a=1&&b=2", are skipped */
+		if (fieldEnd > p) {
+			char* eq = (char*)find(p, fieldEnd, '=', '=');
+			FormField& field = m_fields[m_count++];
+			field.name.data = p;
+			field.name.len = decode(p, eq - p);
+			char* value = eq < fieldEnd ? eq + 1 : fieldEnd;
+			field.value.data = value;
+			field.value.len = decode(value, fieldEnd - value);
+		}
+		if (fieldEnd == end) {
+			break;
+		}
+		p = fieldEnd + 1;
+	}
+	return m_count;
+}
+
+bool FormParser::get(const char* name, StringSlice& value) const
+{
+	for (size_t i = 0; i < m_count; ++i) {
+		if (m_fields[i].name.equals(name)) {
+			value = m_fields[i].value;
+			return true;
+		}
+	}
+	return false;
+}
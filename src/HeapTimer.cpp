@@ -30,40 +30,33 @@ TimeHeap::TimeHeap(int cap): capacity(cap), curSize(0)
 	}
 }
 
-TimeHeap::TimeHeap(HeapTimer** initArray, int size, int capacity)
-: curSize(size), capacity(capacity)
-{
-	if (capacity < size) {
-		throw exception();
-	}
-	array = new HeapTimer*[capacity];		// Create heap array
-	if (array == nullptr) {
-		throw exception();
-	}
-	for (int i = 0; i < capacity; ++i) {
-		array[i] = nullptr;
-	}
-	if (size != 0) {
-		/* Initialize the heap array */
-		for (int i = 0; i < size; ++i) {
-			array[i] = initArray[i];
-		}
-		/* Build a min heap starting from the last non-leaf node */
-		for (int i = (curSize - 1) / 2; i >= 0; --i) {
-			percolateDown(i);
-		}
-	}
-}
-
 TimeHeap::~TimeHeap()
 {
 	for (int i = 0; i < curSize; ++i) {
 		if (array[i] != nullptr) {
-			delete array[i];
+			timerPool.destroy(array[i]);
 			array[i] = nullptr;
 		}
-		delete [] array;
 	}
+	delete [] array;
+}
+
+HeapTimer* TimeHeap::createTimer(int delay)
+{
+	return timerPool.create(delay);
+}
+
+void TimeHeap::reserve(int n)
+{
+	while (capacity < n) {
+		resize();
+	}
+	timerPool.reserve(n);
+}
+
+PoolStats TimeHeap::timerStats() const
+{
+	return timerPool.stats();
 }
 
 void TimeHeap::addTimer(HeapTimer* timer)
@@ -90,11 +83,13 @@ void TimeHeap::delTimer(HeapTimer* timer)
 	swapTimer(loc, curSize - 1);
 	curSize--;
 	percolateDown(loc);
-	delete timer;
+	timerPool.destroy(timer);
 }
 
 void TimeHeap::adjustTimer(HeapTimer* timer)
 {
+	/* The expire time may have moved either way, an idle timeout can be shorter than the busy one */
+	percolateUp(timer->loc);
 	percolateDown(timer->loc);
 }
 
@@ -112,7 +107,7 @@ void TimeHeap::popTimer()
 		return;
 	}
 	if (array[0]) {
-		delete array[0];
+		timerPool.destroy(array[0]);
 		/* Replace the original heap top element with the last element in the heap array */
 		array[0] = array[--curSize];
 		/* Perform percolate down operation on the new heap top element to maintain heap properties */
@@ -133,12 +128,14 @@ void TimeHeap::tick()
 		if (tmp->expire > cur) {
 			break;
 		}
-		/* Otherwise, execute the task of the top timer in a loop */
-		if (array[0]->cbFunc) {
-			array[0]->cbFunc(array[0]->userData);
+		/* Otherwise, execute the task of the top timer in a loop; a callback that put the expire time off keeps its timer */
+		if (array[0]->cbFunc && !array[0]->cbFunc(array[0]->userData)) {
+			adjustTimer(array[0]);
+		}
+		else {
+			/* After executing the task, pop the top element from the heap */
+			popTimer();
 		}
-		/* After executing the task, pop the top element from the heap */
-		popTimer();
 		tmp = array[0];
 	}
 }
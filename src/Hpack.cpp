@@ -0,0 +1,329 @@
+#include <cstdio>
+#include "Hpack.h"
+using namespace std;
+
+/* Static table of RFC 7541 Appendix A, index 0 is unused */
+static const char* const STATIC_TABLE[][2] = {
+	{ "", "" },
+	{ ":authority", "" },
+	{ ":method", "GET" },
+	{ ":method", "POST" },
+	{ ":path", "/" },
+	{ ":path", "/index.html" },
+	{ ":scheme", "http" },
+	{ ":scheme", "https" },
+	{ ":status", "200" },
+	{ ":status", "204" },
+	{ ":status", "206" },
+	{ ":status", "304" },
+	{ ":status", "400" },
+	{ ":status", "404" },
+	{ ":status", "500" },
+	{ "accept-charset", "" },
+	{ "accept-encoding", "gzip, deflate" },
+	{ "accept-language", "" },
+	{ "accept-ranges", "" },
+	{ "accept", "" },
+	{ "access-control-allow-origin", "" },
+	{ "age", "" },
+	{ "allow", "" },
+	{ "authorization", "" },
+	{ "cache-control", "" },
+	{ "content-disposition", "" },
+	{ "content-encoding", "" },
+	{ "content-language", "" },
+	{ "content-length", "" },
+	{ "content-location", "" },
+	{ "content-range", "" },
+	{ "content-type", "" },
+	{ "cookie", "" },
+	{ "date", "" },
+	{ "etag", "" },
+	{ "expect", "" },
+	{ "expires", "" },
+	{ "from", "" },
+	{ "host", "" },
+	{ "if-match", "" },
+	{ "if-modified-since", "" },
+	{ "if-none-match", "" },
+	{ "if-range", "" },
+	{ "if-unmodified-since", "" },
+	{ "last-modified", "" },
+	{ "link", "" },
+	{ "location", "" },
+	{ "max-forwards", "" },
+	{ "proxy-authenticate", "" },
+	{ "proxy-authorization", "" },
+	{ "range", "" },
+	{ "referer", "" },
+	{ "refresh", "" },
+	{ "retry-after", "" },
+	{ "server", "" },
+	{ "set-cookie", "" },
+	{ "strict-transport-security", "" },
+	{ "transfer-encoding", "" },
+	{ "user-agent", "" },
+	{ "vary", "" },
+	{ "via", "" },
+	{ "www-authenticate", "" },
+};
+static constexpr uint64_t STATIC_TABLE_SIZE = sizeof(STATIC_TABLE) / sizeof(STATIC_TABLE[0]) - 1;
+
+/* Code lengths of RFC 7541 Appendix B for symbols 0-255 and EOS. The code is canonical,
+   so the codes themselves follow from the lengths */
+static const uint8_t HUFFMAN_LENGTHS[257] = {
+	13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+	28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+	6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+	5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+	13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+	15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+	6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+	20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+	24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+	22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+	21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+	26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+	19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+	20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+	26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+	30,
+};
+static constexpr int HUFFMAN_MAX_LENGTH = 30;
+static constexpr int HUFFMAN_EOS = 256;
+
+/* Canonical decoding tables: codes of each length are consecutive, in symbol order */
+struct HuffmanTable
+{
+	uint32_t firstCode[HUFFMAN_MAX_LENGTH + 1];
+	int count[HUFFMAN_MAX_LENGTH + 1];
+	int firstIndex[HUFFMAN_MAX_LENGTH + 1];
+	int symbols[257];
+
+	HuffmanTable()
+	{
+		int index = 0;
+		uint32_t code = 0;
+		for (int len = 0; len <= HUFFMAN_MAX_LENGTH; ++len) {
+			if (len > 0) {
+				code = (code + count[len - 1]) << 1;
+			}
+			firstCode[len] = code;
+			firstIndex[len] = index;
+			count[len] = 0;
+			for (int sym = 0; sym < 257; ++sym) {
+				if (HUFFMAN_LENGTHS[sym] == len) {
+					symbols[index++] = sym;
+					count[len]++;
+				}
+			}
+		}
+	}
+};
+
+bool huffmanDecode(const uint8_t* data, size_t len, string& out)
+{
+	static const HuffmanTable table;
+	uint32_t code = 0;
+	int bits = 0;
+	for (size_t i = 0; i < len; ++i) {
+		for (int shift = 7; shift >= 0; --shift) {
+			code = (code << 1) | ((data[i] >> shift) & 1);
+			bits++;
+			if (code - table.firstCode[bits] < (uint32_t)table.count[bits]) {
+				int sym = table.symbols[table.firstIndex[bits] + code - table.firstCode[bits]];
+				if (sym == HUFFMAN_EOS) {
+					return false;
+				}
+				out.push_back((char)sym);
+				code = 0;
+				bits = 0;
+			}
+			else if (bits == HUFFMAN_MAX_LENGTH) {
+				return false;
+			}
+		}
+	}
+	/* Padding is the most significant bits of EOS, all ones and shorter than a byte */
+	return bits < 8 && code == ((uint32_t)1 << bits) - 1;
+}
+
+HpackDecoder::HpackDecoder(size_t maxTableSize)
+: m_tableSize(0), m_tableLimit(maxTableSize), m_maxTableSize(maxTableSize)
+{
+}
+
+bool HpackDecoder::decodeInteger(const uint8_t*& p, const uint8_t* end, int prefix, uint64_t& value)
+{
+	if (p >= end) {
+		return false;
+	}
+	uint64_t mask = (1 << prefix) - 1;
+	value = *p++ & mask;
+	if (value < mask) {
+		return true;
+	}
+	for (int shift = 0; p < end && shift <= 56; shift += 7) {
+		uint8_t byte = *p++;
+		value += (uint64_t)(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool HpackDecoder::decodeString(const uint8_t*& p, const uint8_t* end, string& out)
+{
+	if (p >= end) {
+		return false;
+	}
+	bool huffman = (*p & 0x80) != 0;
+	uint64_t len = 0;
+	if (!decodeInteger(p, end, 7, len) || len > (uint64_t)(end - p)) {
+		return false;
+	}
+	out.clear();
+	if (huffman) {
+		if (!huffmanDecode(p, len, out)) {
+			return false;
+		}
+	}
+	else {
+		out.assign((const char*)p, len);
+	}
+	p += len;
+	return true;
+}
+
+bool HpackDecoder::lookup(uint64_t index, HeaderField& field) const
+{
+	if (index == 0) {
+		return false;
+	}
+	if (index <= STATIC_TABLE_SIZE) {
+		field.name = STATIC_TABLE[index][0];
+		field.value = STATIC_TABLE[index][1];
+		return true;
+	}
+	index -= STATIC_TABLE_SIZE + 1;
+	if (index >= m_table.size()) {
+		return false;
+	}
+	field = m_table[index];
+	return true;
+}
+
+void HpackDecoder::evict(size_t size)
+{
+	while (m_tableSize > size && !m_table.empty()) {
+		m_tableSize -= m_table.back().name.size() + m_table.back().value.size() + 32;
+		m_table.pop_back();
+	}
+}
+
+void HpackDecoder::insert(const HeaderField& field)
+{
+	size_t size = field.name.size() + field.value.size() + 32;
+	/* An entry larger than the whole table empties it and is not added */
+	if (size > m_tableLimit) {
+		evict(0);
+		return;
+	}
+	evict(m_tableLimit - size);
+	m_table.push_front(field);
+	m_tableSize += size;
+}
+
+bool HpackDecoder::decode(const uint8_t* data, size_t len, vector<HeaderField>& headers)
+{
+	const uint8_t* p = data;
+	const uint8_t* end = data + len;
+	bool fieldSeen = false;
+	while (p < end) {
+		uint8_t first = *p;
+		uint64_t index = 0;
+		HeaderField field;
+		/* Indexed header field */
+		if (first & 0x80) {
+			if (!decodeInteger(p, end, 7, index) || !lookup(index, field)) {
+				return false;
+			}
+			headers.push_back(field);
+			fieldSeen = true;
+			continue;
+		}
+		/* Dynamic table size update, only allowed before the first field */
+		if ((first & 0xe0) == 0x20) {
+			if (fieldSeen || !decodeInteger(p, end, 5, index) || index > m_maxTableSize) {
+				return false;
+			}
+			m_tableLimit = index;
+			evict(m_tableLimit);
+			continue;
+		}
+		/* Literal with incremental indexing has a 6-bit prefix, without indexing and never indexed a 4-bit one */
+		bool indexing = (first & 0xc0) == 0x40;
+		if (!decodeInteger(p, end, indexing ? 6 : 4, index)) {
+			return false;
+		}
+		if (index != 0) {
+			if (!lookup(index, field)) {
+				return false;
+			}
+		}
+		else if (!decodeString(p, end, field.name)) {
+			return false;
+		}
+		if (!decodeString(p, end, field.value)) {
+			return false;
+		}
+		if (indexing) {
+			insert(field);
+		}
+		headers.push_back(field);
+		fieldSeen = true;
+	}
+	return true;
+}
+
+void HpackEncoder::encodeInteger(uint64_t value, int prefix, uint8_t first, string& out)
+{
+	uint64_t mask = (1 << prefix) - 1;
+	if (value < mask) {
+		out.push_back((char)(first | value));
+		return;
+	}
+	out.push_back((char)(first | mask));
+	value -= mask;
+	while (value >= 0x80) {
+		out.push_back((char)(0x80 | (value & 0x7f)));
+		value >>= 7;
+	}
+	out.push_back((char)value);
+}
+
+void HpackEncoder::encodeStatus(int status, string& out)
+{
+	/* Statuses in the static table are a single byte */
+	static const int STATUS_INDEX[][2] = {
+		{ 200, 8 }, { 204, 9 }, { 206, 10 }, { 304, 11 }, { 400, 12 }, { 404, 13 }, { 500, 14 },
+	};
+	for (size_t i = 0; i < sizeof(STATUS_INDEX) / sizeof(STATUS_INDEX[0]); ++i) {
+		if (STATUS_INDEX[i][0] == status) {
+			encodeInteger(STATUS_INDEX[i][1], 7, 0x80, out);
+			return;
+		}
+	}
+	char value[4];
+	int len = snprintf(value, sizeof(value), "%03d", status);
+	encodeField(8, value, len, out);
+}
+
+void HpackEncoder::encodeField(int nameIndex, const char* value, size_t len, string& out)
+{
+	encodeInteger(nameIndex, 4, 0x00, out);
+	encodeInteger(len, 7, 0x00, out);
+	out.append(value, len);
+}
@@ -0,0 +1,714 @@
+#include "Http2.h"
+#include "HttpConn.h"
+using namespace std;
+
+const char Http2Session::PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+/* Default initial window of a stream and of the connection */
+static constexpr int64_t DEFAULT_WINDOW = 65535;
+static constexpr int64_t MAX_WINDOW = 0x7fffffff;
+
+static uint32_t readUint32(const uint8_t* p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void writeUint32(uint8_t* p, uint32_t value)
+{
+	p[0] = value >> 24;
+	p[1] = value >> 16;
+	p[2] = value >> 8;
+	p[3] = value;
+}
+
+/* HTTP2-Settings is base64url without padding */
+static bool base64UrlDecode(const string& in, string& out)
+{
+	uint32_t bits = 0;
+	int count = 0;
+	for (size_t i = 0; i < in.size(); ++i) {
+		char c = in[i];
+		int v;
+		if (c >= 'A' && c <= 'Z') {
+			v = c - 'A';
+		}
+		else if (c >= 'a' && c <= 'z') {
+			v = c - 'a' + 26;
+		}
+		else if (c >= '0' && c <= '9') {
+			v = c - '0' + 52;
+		}
+		else if (c == '-' || c == '+') {
+			v = 62;
+		}
+		else if (c == '_' || c == '/') {
+			v = 63;
+		}
+		else if (c == '=') {
+			break;
+		}
+		else {
+			return false;
+		}
+		bits = (bits << 6) | v;
+		count += 6;
+		if (count >= 8) {
+			count -= 8;
+			out.push_back((char)((bits >> count) & 0xff));
+		}
+	}
+	return true;
+}
+
+Http2Session::Http2Session(HttpConn* conn)
+: m_conn(conn), m_streamPool(STREAM_SLAB), m_current(nullptr), m_queuedUpTo(conn->m_writeBuf.size()), m_prefaceSeen(false),
+  m_continuationStream(0), m_continuationEndStream(false), m_lastStreamId(0),
+  m_sendWindow(DEFAULT_WINDOW), m_peerInitialWindow(DEFAULT_WINDOW), m_peerMaxFrameSize(MAX_FRAME_SIZE),
+  m_closing(false), m_goawayReceived(false)
+{
+	/* The server preface is a SETTINGS frame, only the stream limit differs from the defaults */
+	uint8_t settings[6] = { 0, 3 };
+	writeUint32(settings + 2, MAX_CONCURRENT_STREAMS);
+	writeFrame(FRAME_SETTINGS, 0, 0, settings, sizeof(settings));
+}
+
+Http2Session::~Http2Session()
+{
+	for (auto it = m_streams.begin(); it != m_streams.end(); ++it) {
+		if (it->second->fileAddress && !it->second->fileHold) {
+			munmap(it->second->fileAddress, it->second->fileSize);
+		}
+		if (it->second->fileFd != -1) {
+			close(it->second->fileFd);
+		}
+		m_streamPool.destroy(it->second);
+	}
+	onWriteComplete();
+}
+
+void Http2Session::upgrade(const string& settings, int ret)
+{
+	string payload;
+	if (!base64UrlDecode(settings, payload) || !applySettings((const uint8_t*)payload.data(), payload.size())) {
+		goAway(PROTOCOL_ERROR);
+		return;
+	}
+	/* The upgraded request is stream 1, half-closed since its body was read with HTTP/1.1 */
+	Stream* stream = m_streamPool.create();
+	stream->id = 1;
+	stream->sendWindow = m_peerInitialWindow;
+	stream->remoteClosed = true;
+	stream->tooLarge = false;
+	stream->acceptEncoding = 0;
+	stream->fileAddress = nullptr;
+	stream->fileFd = -1;
+	stream->fileSize = 0;
+	stream->sent = 0;
+	m_streams[1] = stream;
+	m_lastStreamId = 1;
+	dispatch(stream, ret);
+}
+
+void Http2Session::process()
+{
+	HttpConn* conn = m_conn;
+	while (!m_closing) {
+		const uint8_t* p = (const uint8_t*)conn->m_readBuf + conn->m_checkedIdx;
+		uint32_t avail = conn->m_readIdx - conn->m_checkedIdx;
+		if (!m_prefaceSeen) {
+			if (avail < (uint32_t)PREFACE_LEN) {
+				break;
+			}
+			if (memcmp(p, PREFACE, PREFACE_LEN) != 0) {
+				goAway(PROTOCOL_ERROR);
+				break;
+			}
+			m_prefaceSeen = true;
+			conn->m_checkedIdx += PREFACE_LEN;
+			continue;
+		}
+		if (avail < 9) {
+			break;
+		}
+		uint32_t len = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+		if (len > MAX_FRAME_SIZE) {
+			goAway(FRAME_SIZE_ERROR);
+			break;
+		}
+		if (avail < 9 + len) {
+			break;
+		}
+		conn->m_checkedIdx += 9 + len;
+		handleFrame(p[3], p[4], readUint32(p + 5) & 0x7fffffff, p + 9, len);
+	}
+	/* Consumed frames are dropped by the next compaction of the read buffer */
+	conn->m_startLine = conn->m_checkedIdx;
+	conn->m_requestStart = conn->m_checkedIdx;
+	flush();
+	queueOutput();
+}
+
+bool Http2Session::wantsWrite() const
+{
+	if (!m_prefaceSeen || m_closing || m_sendWindow <= 0) {
+		return false;
+	}
+	for (size_t i = 0; i < m_sendQueue.size(); ++i) {
+		auto it = m_streams.find(m_sendQueue[i]);
+		if (it != m_streams.end() && it->second->sendWindow > 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void Http2Session::onWriteComplete()
+{
+	for (size_t i = 0; i < m_retired.size(); ++i) {
+		munmap(m_retired[i].first, m_retired[i].second);
+	}
+	m_retired.clear();
+	m_retiredHolds.clear();
+	m_queuedUpTo = 0;
+}
+
+bool Http2Session::isClosing() const
+{
+	return m_closing || (m_goawayReceived && m_sendQueue.empty());
+}
+
+void Http2Session::setStatus(int status)
+{
+	m_current->status = status;
+}
+
+void Http2Session::appendBody(const char* data, size_t len)
+{
+	m_current->respBody.append(data, len);
+}
+
+void Http2Session::setFileBody(char* address, size_t size)
+{
+	m_current->fileAddress = address;
+	m_current->fileSize = size;
+}
+
+void Http2Session::setFileStream(int fd, size_t size)
+{
+	m_current->fileFd = fd;
+	m_current->fileSize = size;
+}
+
+void Http2Session::setSharedBody(const char* data, size_t size, shared_ptr<const void> hold)
+{
+	m_current->fileAddress = (char*)data;
+	m_current->fileSize = size;
+	m_current->fileHold = hold;
+}
+
+void Http2Session::addHeader(int nameIndex, const char* value, size_t len)
+{
+	HpackEncoder::encodeField(nameIndex, value, len, m_current->respHeaders);
+}
+
+void Http2Session::handleFrame(uint8_t type, uint8_t flags, uint32_t streamId, const uint8_t* payload, uint32_t len)
+{
+	/* A header block must not be interleaved with any other frame */
+	if (m_continuationStream != 0 && (type != FRAME_CONTINUATION || streamId != m_continuationStream)) {
+		goAway(PROTOCOL_ERROR);
+		return;
+	}
+	switch (type) {
+	case FRAME_DATA:
+		handleData(flags, streamId, payload, len);
+		break;
+	case FRAME_HEADERS:
+		handleHeaders(flags, streamId, payload, len);
+		break;
+	case FRAME_CONTINUATION:
+	{
+		if (m_continuationStream == 0) {
+			goAway(PROTOCOL_ERROR);
+			return;
+		}
+		m_headerBlock.append((const char*)payload, len);
+		if (flags & FLAG_END_HEADERS) {
+			m_continuationStream = 0;
+			finishHeaders(streamId, m_continuationEndStream);
+		}
+		break;
+	}
+	case FRAME_RST_STREAM:
+	{
+		auto it = m_streams.find(streamId);
+		if (it != m_streams.end()) {
+			closeStream(it->second);
+		}
+		break;
+	}
+	case FRAME_SETTINGS:
+	{
+		if (streamId != 0 || len % 6 != 0) {
+			goAway(PROTOCOL_ERROR);
+			return;
+		}
+		if (flags & FLAG_ACK) {
+			break;
+		}
+		if (applySettings(payload, len)) {
+			writeFrame(FRAME_SETTINGS, FLAG_ACK, 0, nullptr, 0);
+		}
+		break;
+	}
+	case FRAME_PING:
+	{
+		if (streamId != 0 || len != 8) {
+			goAway(PROTOCOL_ERROR);
+			return;
+		}
+		if (!(flags & FLAG_ACK)) {
+			writeFrame(FRAME_PING, FLAG_ACK, 0, payload, len);
+		}
+		break;
+	}
+	case FRAME_GOAWAY:
+		m_goawayReceived = true;
+		break;
+	case FRAME_WINDOW_UPDATE:
+	{
+		if (len != 4) {
+			goAway(FRAME_SIZE_ERROR);
+			return;
+		}
+		uint32_t increment = readUint32(payload) & 0x7fffffff;
+		if (streamId == 0) {
+			if (increment == 0 || m_sendWindow + increment > MAX_WINDOW) {
+				goAway(increment == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR);
+				return;
+			}
+			m_sendWindow += increment;
+		}
+		else {
+			auto it = m_streams.find(streamId);
+			if (it != m_streams.end()) {
+				it->second->sendWindow += increment;
+			}
+		}
+		break;
+	}
+	case FRAME_PUSH_PROMISE:
+		/* Clients never push */
+		goAway(PROTOCOL_ERROR);
+		break;
+	default:
+		/* PRIORITY is advisory and unknown frame types are ignored */
+		break;
+	}
+}
+
+void Http2Session::handleHeaders(uint8_t flags, uint32_t streamId, const uint8_t* payload, uint32_t len)
+{
+	if (streamId == 0) {
+		goAway(PROTOCOL_ERROR);
+		return;
+	}
+	uint32_t padding = 0;
+	if (flags & FLAG_PADDED) {
+		if (len < 1) {
+			goAway(PROTOCOL_ERROR);
+			return;
+		}
+		padding = payload[0];
+		payload++;
+		len--;
+	}
+	if (flags & FLAG_PRIORITY) {
+		if (len < 5) {
+			goAway(PROTOCOL_ERROR);
+			return;
+		}
+		payload += 5;
+		len -= 5;
+	}
+	if (padding > len) {
+		goAway(PROTOCOL_ERROR);
+		return;
+	}
+	m_headerBlock.assign((const char*)payload, len - padding);
+	if (flags & FLAG_END_HEADERS) {
+		finishHeaders(streamId, flags & FLAG_END_STREAM);
+	}
+	else {
+		m_continuationStream = streamId;
+		m_continuationEndStream = flags & FLAG_END_STREAM;
+	}
+}
+
+void Http2Session::finishHeaders(uint32_t streamId, bool endStream)
+{
+	/* Every block is decoded, even one that is refused, to keep the dynamic table in sync */
+	vector<HeaderField> headers;
+	if (!m_decoder.decode((const uint8_t*)m_headerBlock.data(), m_headerBlock.size(), headers)) {
+		goAway(COMPRESSION_ERROR);
+		return;
+	}
+	auto it = m_streams.find(streamId);
+	/* Trailers of a request body, their fields are not used */
+	if (it != m_streams.end()) {
+		Stream* stream = it->second;
+		if (stream->remoteClosed || !endStream) {
+			goAway(PROTOCOL_ERROR);
+			return;
+		}
+		stream->remoteClosed = true;
+		/* A refused body was answered as soon as it went over the limit */
+		if (!stream->tooLarge) {
+			dispatch(stream);
+		}
+		return;
+	}
+	if (streamId % 2 == 0 || streamId <= m_lastStreamId) {
+		goAway(PROTOCOL_ERROR);
+		return;
+	}
+	m_lastStreamId = streamId;
+	if (m_streams.size() >= MAX_CONCURRENT_STREAMS) {
+		writeRstStream(streamId, REFUSED_STREAM);
+		return;
+	}
+
+	Stream* stream = m_streamPool.create();
+	stream->id = streamId;
+	stream->sendWindow = m_peerInitialWindow;
+	stream->remoteClosed = endStream;
+	stream->tooLarge = false;
+	stream->acceptEncoding = 0;
+	stream->status = 200;
+	stream->fileAddress = nullptr;
+	stream->fileFd = -1;
+	stream->fileSize = 0;
+	stream->sent = 0;
+	for (size_t i = 0; i < headers.size(); ++i) {
+		if (headers[i].name == ":method") {
+			stream->method = headers[i].value;
+		}
+		else if (headers[i].name == ":path") {
+			stream->path = headers[i].value;
+		}
+		else if (headers[i].name == "if-none-match") {
+			stream->ifNoneMatch = headers[i].value;
+		}
+		else if (headers[i].name == "accept-encoding") {
+			stream->acceptEncoding = HttpConn::parseAcceptEncoding(headers[i].value.c_str());
+		}
+		else if (headers[i].name == "content-length" && atol(headers[i].value.c_str()) > HttpConn::m_maxBodySize) {
+			stream->tooLarge = true;
+		}
+	}
+	m_streams[streamId] = stream;
+	if (endStream || stream->tooLarge) {
+		dispatch(stream);
+	}
+}
+
+void Http2Session::handleData(uint8_t flags, uint32_t streamId, const uint8_t* payload, uint32_t len)
+{
+	if (streamId == 0) {
+		goAway(PROTOCOL_ERROR);
+		return;
+	}
+	/* The whole frame counts against flow control, give the connection window back right away */
+	if (len > 0) {
+		writeWindowUpdate(0, len);
+	}
+	uint32_t padding = 0;
+	if (flags & FLAG_PADDED) {
+		if (len < 1 || payload[0] > len - 1) {
+			goAway(PROTOCOL_ERROR);
+			return;
+		}
+		padding = payload[0];
+		payload++;
+		len--;
+	}
+	auto it = m_streams.find(streamId);
+	if (it == m_streams.end() || it->second->remoteClosed) {
+		writeRstStream(streamId, STREAM_CLOSED);
+		return;
+	}
+	Stream* stream = it->second;
+	/* A refused body is still drained until END_STREAM */
+	if (!stream->tooLarge) {
+		if (stream->body.size() + len - padding > (size_t)HttpConn::m_maxBodySize) {
+			stream->tooLarge = true;
+			stream->body.clear();
+			dispatch(stream);
+		}
+		else {
+			stream->body.append((const char*)payload, len - padding);
+		}
+	}
+	if (flags & FLAG_END_STREAM) {
+		stream->remoteClosed = true;
+		if (!stream->tooLarge) {
+			dispatch(stream);
+		}
+	}
+	else if (len > 0) {
+		writeWindowUpdate(streamId, len + (flags & FLAG_PADDED ? 1 : 0));
+	}
+}
+
+bool Http2Session::applySettings(const uint8_t* payload, uint32_t len)
+{
+	for (uint32_t i = 0; i + 6 <= len; i += 6) {
+		uint16_t id = ((uint16_t)payload[i] << 8) | payload[i + 1];
+		uint32_t value = readUint32(payload + i + 2);
+		/* SETTINGS_INITIAL_WINDOW_SIZE shifts the window of every open stream */
+		if (id == 4) {
+			if (value > MAX_WINDOW) {
+				goAway(FLOW_CONTROL_ERROR);
+				return false;
+			}
+			int64_t delta = (int64_t)value - m_peerInitialWindow;
+			for (auto it = m_streams.begin(); it != m_streams.end(); ++it) {
+				it->second->sendWindow += delta;
+			}
+			m_peerInitialWindow = value;
+		}
+		/* SETTINGS_MAX_FRAME_SIZE */
+		else if (id == 5) {
+			if (value < 16384 || value > 16777215) {
+				goAway(PROTOCOL_ERROR);
+				return false;
+			}
+			m_peerMaxFrameSize = value;
+		}
+		/* The encoder never indexes and the server never pushes, the other settings do not matter */
+	}
+	return true;
+}
+
+void Http2Session::dispatch(Stream* stream)
+{
+	HttpConn* conn = m_conn;
+	int ret;
+	if (stream->tooLarge) {
+		ret = HttpConn::ENTITY_TOO_LARGE;
+	}
+	else if ((stream->method != "GET" && stream->method != "POST") || stream->path.empty() || stream->path[0] != '/') {
+		ret = HttpConn::BAD_REQUEST;
+	}
+	else {
+		/* Present the stream as an HTTP/1.1 request to the shared handlers */
+		conn->m_method = stream->method == "POST" ? HttpConn::POST : HttpConn::GET;
+		char* path = &stream->path[0];
+		HttpConn::stripQuery(path);
+		conn->m_url = strcmp(path, "/") == 0 ? "/judge.html" : path;
+		conn->m_body = stream->body.empty() ? nullptr : &stream->body[0];
+		conn->m_bodyLen = stream->body.size();
+		conn->m_http11 = true;
+		conn->m_linger = true;
+		conn->m_generator = nullptr;
+		conn->m_acceptEncoding = stream->acceptEncoding;
+		conn->m_contentEncoding = ENCODING_IDENTITY;
+		conn->m_vary = false;
+		conn->m_mimeType = nullptr;
+		conn->m_ifNoneMatch = stream->ifNoneMatch.empty() ? nullptr : stream->ifNoneMatch.c_str();
+		ret = conn->doRequest();
+		/* Streams are answered one after another within process(), their filesystem work is done right here */
+		if (ret == HttpConn::FILE_PENDING) {
+			conn->runFileTask();
+			ret = conn->takeFileResult();
+		}
+	}
+	dispatch(stream, ret);
+}
+
+void Http2Session::dispatch(Stream* stream, int ret)
+{
+	m_current = stream;
+	stream->status = 200;
+	m_conn->processWrite((HttpConn::HTTP_CODE)ret);
+	m_current = nullptr;
+	/* The stream holds what the body needs, the connection drops its references */
+	m_conn->m_bundle.reset();
+	m_conn->m_asset = nullptr;
+	m_conn->m_arena.reset();
+
+	size_t bodyLen = stream->fileAddress || stream->fileFd != -1 ? stream->fileSize : stream->respBody.size();
+	string block;
+	HpackEncoder::encodeStatus(stream->status, block);
+	/* A 304 has no body, and a content-length would have to be the one of the 200 */
+	if (stream->status != 304) {
+		char length[24];
+		int n = snprintf(length, sizeof(length), "%zu", bodyLen);
+		HpackEncoder::encodeField(HpackEncoder::CONTENT_LENGTH, length, n, block);
+	}
+	block += stream->respHeaders;
+	writeFrame(FRAME_HEADERS, FLAG_END_HEADERS | (bodyLen == 0 ? FLAG_END_STREAM : 0),
+			   stream->id, block.data(), block.size());
+	if (bodyLen == 0) {
+		closeStream(stream);
+	}
+	else {
+		m_sendQueue.push_back(stream->id);
+	}
+}
+
+void Http2Session::flush()
+{
+	/* After an upgrade DATA waits for the preface: the client has then switched to HTTP/2, and some
+	   refuse to buffer much more than the 101 before they do */
+	if (!m_prefaceSeen) {
+		return;
+	}
+	size_t budget = FLUSH_BUDGET;
+	bool progress = true;
+	/* One frame per stream and round, so concurrent responses are interleaved */
+	while (progress && m_sendWindow > 0 && budget > 0 && !m_closing) {
+		progress = false;
+		size_t rounds = m_sendQueue.size();
+		for (size_t i = 0; i < rounds && m_sendWindow > 0 && budget > 0; ++i) {
+			uint32_t id = m_sendQueue.front();
+			m_sendQueue.pop_front();
+			auto it = m_streams.find(id);
+			if (it == m_streams.end()) {
+				continue;
+			}
+			Stream* stream = it->second;
+			if (stream->sendWindow <= 0) {
+				m_sendQueue.push_back(id);
+				continue;
+			}
+			size_t total = stream->fileAddress || stream->fileFd != -1 ? stream->fileSize : stream->respBody.size();
+			size_t len = total - stream->sent;
+			len = len < m_peerMaxFrameSize ? len : m_peerMaxFrameSize;
+			len = (int64_t)len < stream->sendWindow ? len : stream->sendWindow;
+			len = (int64_t)len < m_sendWindow ? len : m_sendWindow;
+			len = len < budget ? len : budget;
+			bool last = stream->sent + len == total;
+
+			/* Large files are read right behind the frame header, small ones go out straight from the mapping,
+			   generated bodies are copied next to the header */
+			if (stream->fileFd != -1) {
+				if (!readFileFrame(stream, len, last)) {
+					writeRstStream(id, INTERNAL_ERROR);
+					closeStream(stream);
+					continue;
+				}
+			}
+			else if (stream->fileAddress) {
+				writeFrameHeader(FRAME_DATA, last ? FLAG_END_STREAM : 0, id, len);
+				queueOutput(stream->fileAddress + stream->sent, len);
+			}
+			else {
+				writeFrameHeader(FRAME_DATA, last ? FLAG_END_STREAM : 0, id, len);
+				m_conn->m_writeBuf.append(stream->respBody.data() + stream->sent, len);
+			}
+			stream->sent += len;
+			stream->sendWindow -= len;
+			m_sendWindow -= len;
+			budget -= len;
+			progress = true;
+			if (last) {
+				closeStream(stream);
+			}
+			else {
+				m_sendQueue.push_back(id);
+			}
+		}
+	}
+}
+
+bool Http2Session::readFileFrame(Stream* stream, size_t len, bool last)
+{
+	char* frame = m_conn->m_writeBuf.prepare(9 + len);
+	ssize_t n = pread(stream->fileFd, frame + 9, len, stream->sent);
+	/* A short read would break the promised content-length */
+	if (n != (ssize_t)len) {
+		return false;
+	}
+	packFrameHeader((uint8_t*)frame, FRAME_DATA, last ? FLAG_END_STREAM : 0, stream->id, len);
+	m_conn->m_writeBuf.commit(9 + len);
+	if (!last) {
+		posix_fadvise(stream->fileFd, stream->sent + len, HttpConn::STREAM_WINDOW, POSIX_FADV_WILLNEED);
+	}
+	return true;
+}
+
+void Http2Session::closeStream(Stream* stream)
+{
+	if (stream->fileHold) {
+		m_retiredHolds.push_back(stream->fileHold);
+	}
+	else if (stream->fileAddress) {
+		m_retired.push_back(make_pair(stream->fileAddress, stream->fileSize));
+	}
+	if (stream->fileFd != -1) {
+		close(stream->fileFd);
+	}
+	m_streams.erase(stream->id);
+	m_streamPool.destroy(stream);
+}
+
+void Http2Session::packFrameHeader(uint8_t* header, uint8_t type, uint8_t flags, uint32_t streamId, uint32_t len)
+{
+	header[0] = len >> 16;
+	header[1] = len >> 8;
+	header[2] = len;
+	header[3] = type;
+	header[4] = flags;
+	writeUint32(header + 5, streamId);
+}
+
+void Http2Session::writeFrameHeader(uint8_t type, uint8_t flags, uint32_t streamId, uint32_t len)
+{
+	uint8_t header[9];
+	packFrameHeader(header, type, flags, streamId, len);
+	m_conn->m_writeBuf.append((const char*)header, sizeof(header));
+}
+
+void Http2Session::writeFrame(uint8_t type, uint8_t flags, uint32_t streamId, const void* payload, uint32_t len)
+{
+	writeFrameHeader(type, flags, streamId, len);
+	if (len > 0) {
+		m_conn->m_writeBuf.append((const char*)payload, len);
+	}
+}
+
+void Http2Session::writeWindowUpdate(uint32_t streamId, uint32_t increment)
+{
+	uint8_t payload[4];
+	writeUint32(payload, increment);
+	writeFrame(FRAME_WINDOW_UPDATE, 0, streamId, payload, sizeof(payload));
+}
+
+void Http2Session::writeRstStream(uint32_t streamId, uint32_t error)
+{
+	uint8_t payload[4];
+	writeUint32(payload, error);
+	writeFrame(FRAME_RST_STREAM, 0, streamId, payload, sizeof(payload));
+}
+
+void Http2Session::goAway(uint32_t error)
+{
+	if (m_closing) {
+		return;
+	}
+	uint8_t payload[8];
+	writeUint32(payload, m_lastStreamId);
+	writeUint32(payload + 4, error);
+	writeFrame(FRAME_GOAWAY, 0, 0, payload, sizeof(payload));
+	m_closing = true;
+}
+
+void Http2Session::queueOutput(char* fileAddress, size_t fileSize)
+{
+	size_t end = m_conn->m_writeBuf.size();
+	if (end == m_queuedUpTo && fileSize == 0) {
+		return;
+	}
+	m_conn->queueResponse(m_queuedUpTo, fileAddress, fileSize, false);
+	m_queuedUpTo = end;
+}
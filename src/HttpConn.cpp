@@ -1,22 +1,38 @@
 #include "HttpConn.h"
+#include "Http2.h"
 using namespace std;
 
-/* Define some status information for HTTP responses */
-const char* OK_200_TITLE = "OK";
-const char* ERROR_400_TITLE = "Bad Request";
-const char* ERROR_400_FORM = "ERROR_400: Your request has bad syntax or is inherently impossible to satisfy.\n";
-const char* ERROR_403_TITLE = "Forbidden";
-const char* ERROR_403_FORM = "ERROR_403: You do not have permission to get file from this server.\n";
-const char* ERROR_404_TITLE = "Not Found";
-const char* ERROR_404_FORM = "ERROR_404: The requested file was not found on this server.\n";
-const char* ERROR_500_TITLE = "Internal Error";
-const char* ERROR_500_FORM = "ERROR_500: There was an unusual problem serving the requested file.\n";
-
 /* Record usernames and passwords */
 static unordered_map<string, string> m_users;
 /* Lock */
 static Locker m_lock;
 
+/* Codings in order of preference: brotli is denser than gzip on text */
+static const ContentEncoding PREFERRED_CODINGS[] = { ENCODING_BROTLI, ENCODING_GZIP };
+
+/* Whether a decoded form field is free of NUL and other control bytes, which no name or password holds */
+static bool isPlainText(const StringSlice& field)
+{
+	for (size_t i = 0; i < field.len; ++i) {
+		unsigned char c = (unsigned char)field.data[i];
+		if (c < 0x20 || c == 0x7f) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Whether a request path has a ".." segment, which could name something outside the root directory */
+static bool hasParentSegment(const char* path)
+{
+	for (const char* p = strstr(path, ".."); p != nullptr; p = strstr(p + 2, "..")) {
+		if ((p == path || p[-1] == '/') && (p[2] == '\0' || p[2] == '/')) {
+			return true;
+		}
+	}
+	return false;
+}
+
 /* Set file descriptor to non-blocking mode */
 static int setNonblocking(int fd)
 {
@@ -52,6 +68,28 @@ void removefd(int epollfd, int fd)
 	close(fd);
 }
 
+/* Events of a connection registered once for its lifetime in single-owner scheduling */
+static constexpr uint32_t OWNED_EVENTS = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP;
+
+/* Register a connection for both directions, edge triggered and without EPOLLONESHOT */
+static void addOwnedfd(int epollfd, int fd)
+{
+	epoll_event event;
+	event.data.fd = fd;
+	event.events = OWNED_EVENTS;
+	epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
+	setNonblocking(fd);
+}
+
+/* Have the kernel look at a connection again, an edge it is ready for is reported anew */
+static void repollfd(int epollfd, int fd)
+{
+	epoll_event event;
+	event.data.fd = fd;
+	event.events = OWNED_EVENTS;
+	epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event);
+}
+
 static void modfd(int epollfd, int fd, int ev, TriggerMode mode)
 {
 	epoll_event event;
@@ -69,23 +107,55 @@ static void modfd(int epollfd, int fd, int ev, TriggerMode mode)
 /* Static member variables of the class must be initialized outside the class */
 int HttpConn::m_userCount = 0;
 int HttpConn::m_epollfd = -1;
+FileIoPool<HttpConn>* HttpConn::m_ioPool = nullptr;
+int HttpConn::m_maxHeaderSize = 8 * 1024;
+int HttpConn::m_maxBodySize = 1024 * 1024;
+int HttpConn::m_maxRequests = 1000;
+int HttpConn::m_idleTimeout = 15;
+bool HttpConn::m_writeThrough = true;
+bool HttpConn::m_singleOwner = false;
+bool HttpConn::m_inlineStatic = false;
+thread_local bool HttpConn::m_onLoop = false;
+
+HttpConn::HttpConn(): m_readBuf(nullptr), m_readSize(0), m_writeBuf(WRITE_BUFFER_SIZE),
+	m_http2(nullptr), m_owner(OWNER_NONE), m_inFileIo(false), m_fileAddress(nullptr), m_fileTask(TASK_NONE), m_fileFd(-1), m_streamFd(-1),
+	m_streamRemaining(0), m_streamBuf(nullptr), m_streamBufSize(0)
+{
+}
+
+HttpConn::~HttpConn()
+{
+	releaseBuffers();
+}
 
 void HttpConn::closeConn(bool realClose)
 {
-	if (realClose && m_sockfd != -1) {
-		removefd(m_epollfd, m_sockfd);
-		m_sockfd = -1;
-		m_userCount--;	/* Decrease the total number of clients when closing a connection */
-		printf("close %d\n", m_sockfd);
+	releaseBuffers();
+	/* Parked writable with a fresh look at the socket: a failed one reports an error, a healthy one is writable,
+	   and either event fails readn() or writen() so the loop closes it like any other failed connection */
+	if (realClose && m_sockfd != -1 && !m_closing) {
+		m_closing = true;
+		m_writeBlocked = false;
+		park(EPOLLOUT);
 	}
 }
-void HttpConn::init(int sockfd, const sockaddr_in& addr, char* root, TriggerMode mode, 
-			int closeLog, string user, string password, string dbName)
+void HttpConn::init(int sockfd, const sockaddr_in& addr, char* root, TriggerMode mode, int closeLog)
 {
 	m_sockfd = sockfd;
 	m_address = addr;
 
-	addfd(m_epollfd, sockfd, true, mode);
+	/* Set before the socket is registered, its first event may be handled right away */
+	m_owner = OWNER_NONE;
+	m_closing = false;
+	m_waitWrite = false;
+	m_readDrained = true;
+	m_writeBlocked = false;
+	if (m_singleOwner) {
+		addOwnedfd(m_epollfd, sockfd);
+	}
+	else {
+		addfd(m_epollfd, sockfd, true, mode);
+	}
 	m_userCount++;
 
 	/* When the browser resets, it may be due to an error in the website root directory,
@@ -94,36 +164,136 @@ void HttpConn::init(int sockfd, const sockaddr_in& addr, char* root, TriggerMode
 	m_mode = mode;
 	m_closeLog = closeLog;
 
-	/* Initialize database-related parameters */
-	strcpy(m_dbUser, user.c_str());
-	strcpy(m_dbPassword, password.c_str());
-	strcpy(m_dbName, dbName.c_str());
-
 	init();
 }
 
 void HttpConn::init()
 {
+	/* Nothing to clear: the buffers go back to the pool and the parser never reads past m_readIdx */
+	releaseBuffers();
 	m_mysql = nullptr;
-	m_checkState = CHECK_STATE_REQUESTLINE;
-	m_linger = false;
-	m_method = GET;
-	m_url = nullptr;
-	m_version = nullptr;
-	m_contentLength = 0;
-	m_host = nullptr;
 	m_startLine = 0;
 	m_checkedIdx = 0;
 	m_readIdx = 0;
-	m_writeIdx = 0;
+	m_responses.clear();
+	m_requestCount = 0;
+	m_closeAfterWrite = false;
+	m_ivCount = 0;
+	m_ivIndex = 0;
 	m_bytesToSend = 0;
 	m_bytesHaveSend = 0;
+	m_turnWritten = 0;
 	m_timerFlag = 0;
 	m_improv = 0;
 	m_state = 0;
-	bzero(m_readBuf, READ_BUFFER_SIZE);
-	bzero(m_writeBuf, WRITE_BUFFER_SIZE);
-	bzero(m_realFile, FILENAME_LEN);
+	m_fileTask = TASK_NONE;
+	m_routePending = false;
+	m_passOn = false;
+	m_taskOnWorker = false;
+	resetRequest();
+}
+
+void HttpConn::resetRequest()
+{
+	m_checkState = CHECK_STATE_REQUESTLINE;
+	m_linger = false;
+	m_method = GET;
+	m_url = nullptr;
+	m_version = nullptr;
+	m_contentLength = 0;
+	m_http11 = false;
+	m_chunked = false;
+	m_host = nullptr;
+	m_ifNoneMatch = nullptr;
+	m_generator = nullptr;
+	m_upgradeH2c = false;
+	m_h2Settings.clear();
+	m_acceptEncoding = 0;
+	m_contentEncoding = ENCODING_IDENTITY;
+	m_vary = false;
+	m_mimeType = nullptr;
+	m_cachedBody.reset();
+	m_page.reset();
+	m_body = nullptr;
+	m_bodyLen = 0;
+	m_arena.reset();
+	m_bundle.reset();
+	m_asset = nullptr;
+	/* A pipelined request starts right where the previous one ended */
+	m_requestStart = m_checkedIdx;
+}
+
+void HttpConn::compactReadBuffer()
+{
+	if (m_requestStart != 0) {
+		moveReadBuffer(m_readBuf);
+	}
+}
+
+void HttpConn::growReadBuffer(size_t size)
+{
+	char* oldBuf = m_readBuf;
+	size_t oldSize = m_readSize;
+	m_readSize = size;
+	char* newBuf = BufferPool::getInstance()->acquire(m_readSize);
+	moveReadBuffer(newBuf);
+	BufferPool::getInstance()->release(oldBuf, oldSize);
+}
+
+void HttpConn::moveReadBuffer(char* dest)
+{
+	int start = m_requestStart;
+	int remain = m_readIdx - start;
+	if (remain > 0) {
+		memmove(dest, m_readBuf + start, remain);
+	}
+	/* Fields of a partly parsed request point into the bytes that just moved */
+	const char* begin = m_readBuf + start;
+	const char* end = m_readBuf + m_readIdx;
+	if (m_url >= begin && m_url < end) {
+		m_url = dest + (m_url - begin);
+	}
+	if (m_version >= begin && m_version < end) {
+		m_version = dest + (m_version - begin);
+	}
+	if (m_host >= begin && m_host < end) {
+		m_host = dest + (m_host - begin);
+	}
+	if (m_ifNoneMatch >= begin && m_ifNoneMatch < end) {
+		m_ifNoneMatch = dest + (m_ifNoneMatch - begin);
+	}
+	if (m_chunked) {
+		m_rawIdx -= start;
+	}
+	m_readBuf = dest;
+	m_readIdx = remain;
+	m_checkedIdx -= start;
+	m_startLine -= start;
+	m_requestStart = 0;
+}
+
+void HttpConn::releaseBuffers()
+{
+	unmap();
+	closeFileStream();
+	delete m_http2;
+	m_http2 = nullptr;
+	BufferPool* pool = BufferPool::getInstance();
+	if (m_readBuf != nullptr) {
+		pool->release(m_readBuf, m_readSize);
+		m_readBuf = nullptr;
+		m_readSize = 0;
+	}
+	m_writeBuf.clear();
+}
+
+bool HttpConn::hasBufferedRequest() const
+{
+	/* Responses still queued are written first, a budget or EAGAIN may have stopped them part way */
+	if (m_bytesToSend > 0) {
+		return false;
+	}
+	return m_readIdx > m_checkedIdx || m_streamRemaining > 0 || (m_http2 != nullptr && m_http2->wantsWrite());
 }
 
 sockaddr_in* HttpConn::getAddress()
@@ -182,35 +352,72 @@ HttpConn::LINE_STATUS HttpConn::parseLine()
 /* Read customer data in a loop until there is no data to read or the other party closes the connection */
 bool HttpConn::readn()
 {
-	if (m_readIdx >= READ_BUFFER_SIZE) {
+	if (m_closing) {
 		return false;
 	}
+	/* Borrow the read buffer only once the client actually sends something */
+	if (m_readBuf == nullptr) {
+		m_readSize = READ_BUFFER_SIZE;
+		m_readBuf = BufferPool::getInstance()->acquire(m_readSize);
+	}
+	/* Any single request fits in this much, bytes of further pipelined requests wait in the socket.
+	   One byte is kept free so the parser can always terminate the last field in place */
+	int limit = m_maxHeaderSize + m_maxBodySize;
+	if (m_readIdx >= (int)m_readSize - 1) {
+		compactReadBuffer();
+	}
+	if (m_readIdx >= limit) {
+		return false;
+	}
+	/* Whatever the read buffer cannot take lands here and is copied into a bigger buffer afterwards */
+	char spill[READ_SPILL_SIZE];
+	struct iovec iv[2];
 	int bytesRead = 0;
+	int turnRead = 0;
 
-    /* Read data in LT mode */
-	if (m_mode == EPOLL_LT) {
-		bytesRead = recv(m_sockfd, m_readBuf + m_readIdx, READ_BUFFER_SIZE - m_readIdx, 0);
-		if (bytesRead <= 0) {
-			return false;
+	/* Bytes left in the socket at the limit or the budget raise no further edge */
+	m_readDrained = false;
+	while (m_readIdx < limit && turnRead < READ_BUDGET) {
+		int room = m_readSize - 1 - m_readIdx;
+		int spillRoom = limit - m_readIdx - room;
+		if (spillRoom > READ_SPILL_SIZE) {
+			spillRoom = READ_SPILL_SIZE;
 		}
-		m_readIdx += bytesRead;
-	}
-	/* Read data in ET mode, read all data at once */
-	else {
-		while (true) {
-			bytesRead = recv(m_sockfd, m_readBuf + m_readIdx, READ_BUFFER_SIZE - 
-							m_readIdx, 0);
-			if (bytesRead == -1) {
-				if (errno == EAGAIN || errno == EWOULDBLOCK) {
-					break;
-				}
-				return false;
-			}
-			else if (bytesRead == 0) {
-				return false;
+		iv[0].iov_base = m_readBuf + m_readIdx;
+		iv[0].iov_len = room > 0 ? room : 0;
+		iv[1].iov_base = spill;
+		iv[1].iov_len = spillRoom > 0 ? spillRoom : 0;
+		bytesRead = readv(m_sockfd, iv, 2);
+		if (bytesRead == -1) {
+			/* Read data in ET mode until the socket is drained */
+			if (m_mode == EPOLL_ET && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+				m_readDrained = true;
+				break;
 			}
+			return false;
+		}
+		else if (bytesRead == 0) {
+			return false;
+		}
+		turnRead += bytesRead;
+		if (bytesRead <= room) {
 			m_readIdx += bytesRead;
 		}
+		else {
+			m_readIdx += room;
+			int spilled = bytesRead - room;
+			size_t size = m_readSize * 2;
+			while (size < (size_t)(m_readIdx + spilled + 1)) {
+				size *= 2;
+			}
+			growReadBuffer(size);
+			memcpy(m_readBuf + m_readIdx, spill, spilled);
+			m_readIdx += spilled;
+		}
+		/* Read data in LT mode, one call per event */
+		if (m_mode == EPOLL_LT) {
+			break;
+		}
 	}
 	return true;
 }
@@ -218,11 +425,11 @@ bool HttpConn::readn()
 /* Parse the HTTP request line to obtain the request method, target URL, and HTTP version number */
 HttpConn::HTTP_CODE HttpConn::parseRequestLine(char* text)
 {
-	m_url = strpbrk(text, " \t");
-	if (m_url == nullptr) {
+	char* url = strpbrk(text, " \t");
+	if (url == nullptr) {
 		return BAD_REQUEST;
 	}
-	*m_url++ = '\0';
+	*url++ = '\0';
 	
 	char* method = text;
 	if (strcasecmp(method, "GET") == 0) {
@@ -236,31 +443,39 @@ HttpConn::HTTP_CODE HttpConn::parseRequestLine(char* text)
 	}
 
 	/* Skip spaces and tabs in between */
-	m_url += strspn(m_url, " \t");
-	m_version = strpbrk(m_url, " \t");
+	url += strspn(url, " \t");
+	m_version = strpbrk(url, " \t");
 	if (m_version == nullptr) {
 		return BAD_REQUEST;
 	}
 	*m_version++ = '\0';
 	m_version += strspn(m_version, " \t");
-	if (strcasecmp(m_version, "HTTP/1.1") != 0) {
+	/* HTTP/1.1 connections persist unless the client asks to close, HTTP/1.0 ones only when asked to stay */
+	if (strcasecmp(m_version, "HTTP/1.1") == 0) {
+		m_http11 = true;
+		m_linger = true;
+	}
+	else if (strcasecmp(m_version, "HTTP/1.0") != 0) {
 		return BAD_REQUEST;
 	}
-	if (strncasecmp(m_url, "http://", 7) == 0) {
-		m_url += 7;
-		m_url = strchr(m_url, '/');
+	if (strncasecmp(url, "http://", 7) == 0) {
+		url += 7;
+		url = strchr(url, '/');
 	}
-	if (strncasecmp(m_url, "https://", 8) == 0) {
-		m_url += 8;
-		m_url = strchr(m_url, '/');
+	else if (strncasecmp(url, "https://", 8) == 0) {
+		url += 8;
+		url = strchr(url, '/');
 	}
 
-	if (!m_url || m_url[0] != '/') {
+	if (!url || url[0] != '/') {
 		return BAD_REQUEST;
 	}
-	/* Set the default access page when the URL address is set to '/' */
+	stripQuery(url);
+	m_url = url;
+	/* Set the default access page when the URL address is set to '/',
+	   the buffer is left alone since a pipelined request may follow this one */
 	if (strlen(m_url) == 1) {
-		strcat(m_url, "judge.html");
+		m_url = "/judge.html";
 	}
 
 	m_checkState = CHECK_STATE_HEADER;
@@ -272,6 +487,18 @@ HttpConn::HTTP_CODE HttpConn::parseHeaders(char* text)
 {
 	/* When encountering an empty line, it indicates that the header field parsing is complete */
 	if (text[0] == '\0') {
+		if (m_checkedIdx - m_requestStart > m_maxHeaderSize) {
+			return HEADER_TOO_LARGE;
+		}
+		/* A chunked body is decoded as it arrives, its length is counted from zero and Content-Length is ignored */
+		if (m_chunked) {
+			m_contentLength = 0;
+			m_chunkState = CHUNK_SIZE;
+			m_chunkSize = 0;
+			m_rawIdx = m_checkedIdx;
+			m_checkState = CHECK_STATE_CONTENT;
+			return NO_REQUEST;
+		}
 		/* If the HTTP request has a request body, the state machine transitions to CHECK_STATE_CONTENT */	
 		if (m_contentLength != 0) {
 			m_checkState = CHECK_STATE_CONTENT;
@@ -282,9 +509,23 @@ HttpConn::HTTP_CODE HttpConn::parseHeaders(char* text)
 	}
 	/* Handle the Connection header field */
 	else if (strncasecmp(text, "Connection:", 11) == 0) {
-		text += 11;
-		text += strspn(text, " \t");
-		if (strcasecmp(text, "keep-alive") == 0) {
+		/* A comma-separated list of options where close wins over keep-alive */
+		bool close = false;
+		bool keepAlive = false;
+		char* save = nullptr;
+		for (char* option = strtok_r(text + 11, ", \t", &save); option != nullptr;
+			 option = strtok_r(nullptr, ", \t", &save)) {
+			if (strcasecmp(option, "close") == 0) {
+				close = true;
+			}
+			else if (strcasecmp(option, "keep-alive") == 0) {
+				keepAlive = true;
+			}
+		}
+		if (close) {
+			m_linger = false;
+		}
+		else if (keepAlive) {
 			m_linger = true;
 		}
 	}
@@ -293,6 +534,45 @@ HttpConn::HTTP_CODE HttpConn::parseHeaders(char* text)
 		text += 15;
 		text += strspn(text, " \t");
 		m_contentLength = atoi(text);
+		if (m_contentLength < 0) {
+			return BAD_REQUEST;
+		}
+		if (m_contentLength > m_maxBodySize) {
+			return ENTITY_TOO_LARGE;
+		}
+	}
+	/* Handle the Transfer-Encoding header field, chunked is the only coding understood */
+	else if (strncasecmp(text, "Transfer-Encoding:", 18) == 0) {
+		text += 18;
+		text += strspn(text, " \t");
+		if (strcasecmp(text, "chunked") != 0) {
+			return BAD_REQUEST;
+		}
+		m_chunked = true;
+	}
+	/* Handle the Accept-Encoding header field */
+	else if (strncasecmp(text, "Accept-Encoding:", 16) == 0) {
+		m_acceptEncoding = parseAcceptEncoding(text + 16);
+	}
+	else if (strncasecmp(text, "If-None-Match:", 14) == 0) {
+		text += 14;
+		text += strspn(text, " \t");
+		m_ifNoneMatch = text;
+	}
+	/* Handle the Upgrade header field, cleartext HTTP/2 is the only protocol offered */
+	else if (strncasecmp(text, "Upgrade:", 8) == 0) {
+		char* save = nullptr;
+		for (char* protocol = strtok_r(text + 8, ", \t", &save); protocol != nullptr;
+			 protocol = strtok_r(nullptr, ", \t", &save)) {
+			if (strcasecmp(protocol, "h2c") == 0) {
+				m_upgradeH2c = true;
+			}
+		}
+	}
+	else if (strncasecmp(text, "HTTP2-Settings:", 15) == 0) {
+		text += 15;
+		text += strspn(text, " \t");
+		m_h2Settings = text;
 	}
 	/* Handle the HOST header field */
 	else if (strncasecmp(text, "Host:", 5) == 0) {
@@ -308,15 +588,113 @@ HttpConn::HTTP_CODE HttpConn::parseHeaders(char* text)
 
 HttpConn::HTTP_CODE HttpConn::parseContent(char* text)
 {
+	if (m_chunked) {
+		HTTP_CODE ret = parseChunked();
+		if (ret == GET_REQUEST) {
+			m_body = text;
+			m_bodyLen = m_contentLength;
+			/* The next pipelined request starts after the trailer */
+			m_checkedIdx = m_rawIdx;
+			m_startLine = m_checkedIdx;
+		}
+		return ret;
+	}
 	if (m_readIdx >= (m_contentLength + m_checkedIdx)) {
-		text[m_contentLength] = '\0';
 		/* The content of the message body in the POST request is the user name and password entered by the user */
-		m_namePassword = text;
+		m_body = text;
+		m_bodyLen = m_contentLength;
+		/* Step over the body, a pipelined request may follow it */
+		m_checkedIdx += m_contentLength;
+		m_startLine = m_checkedIdx;
 		return GET_REQUEST;
 	}
 	return NO_REQUEST;
 }
 
+/* Decode a chunked body in place: chunk data is moved down over the size lines as it arrives,
+   so the decoded body ends up contiguous right after the headers */
+HttpConn::HTTP_CODE HttpConn::parseChunked()
+{
+	char* body = m_readBuf + m_checkedIdx;
+	HTTP_CODE ret = NO_REQUEST;
+	while (ret == NO_REQUEST) {
+		if (m_chunkState == CHUNK_DATA) {
+			long n = m_readIdx - m_rawIdx < m_chunkSize ? m_readIdx - m_rawIdx : m_chunkSize;
+			memmove(body + m_contentLength, m_readBuf + m_rawIdx, n);
+			m_contentLength += n;
+			m_rawIdx += n;
+			m_chunkSize -= n;
+			if (m_chunkSize > 0) {
+				break;
+			}
+			m_chunkState = CHUNK_DATA_END;
+			continue;
+		}
+		char* line = m_readBuf + m_rawIdx;
+		char* end = (char*)memchr(line, '\n', m_readIdx - m_rawIdx);
+		if (end == nullptr) {
+			if (m_readIdx - m_rawIdx > CHUNK_LINE_MAX) {
+				ret = BAD_REQUEST;
+			}
+			break;
+		}
+		m_rawIdx = end + 1 - m_readBuf;
+		if (end > line && end[-1] == '\r') {
+			end--;
+		}
+		*end = '\0';
+
+		switch (m_chunkState) {
+		case CHUNK_SIZE:
+		{
+			/* Chunk extensions after ';' are ignored */
+			char* sizeEnd = nullptr;
+			long size = strtol(line, &sizeEnd, 16);
+			if (sizeEnd == line || size < 0 || (*sizeEnd != '\0' && *sizeEnd != ';' && *sizeEnd != ' ')) {
+				ret = BAD_REQUEST;
+			}
+			else if (size == 0) {
+				m_chunkState = CHUNK_TRAILER;
+			}
+			else if (size > m_maxBodySize - m_contentLength) {
+				ret = ENTITY_TOO_LARGE;
+			}
+			else {
+				m_chunkSize = size;
+				m_chunkState = CHUNK_DATA;
+			}
+			break;
+		}
+		case CHUNK_DATA_END:
+		{
+			if (line[0] != '\0') {
+				ret = BAD_REQUEST;
+			}
+			m_chunkState = CHUNK_SIZE;
+			break;
+		}
+		case CHUNK_TRAILER:
+		{
+			/* Trailer fields are skipped, an empty line ends the body */
+			if (line[0] == '\0') {
+				ret = GET_REQUEST;
+			}
+			break;
+		}
+		default:
+			break;
+		}
+	}
+	/* Close the gap left by the size lines, the buffer then only holds the decoded body and unread bytes */
+	int bodyEnd = m_checkedIdx + m_contentLength;
+	if (ret == NO_REQUEST && m_rawIdx > bodyEnd) {
+		memmove(m_readBuf + bodyEnd, m_readBuf + m_rawIdx, m_readIdx - m_rawIdx);
+		m_readIdx -= m_rawIdx - bodyEnd;
+		m_rawIdx = bodyEnd;
+	}
+	return ret;
+}
+
 /* Main state machine */
 HttpConn::HTTP_CODE HttpConn::processRead()
 {
@@ -342,8 +720,8 @@ HttpConn::HTTP_CODE HttpConn::processRead()
 		case CHECK_STATE_HEADER:
 		{
 			ret = parseHeaders(text);
-			if (ret == BAD_REQUEST) {
-				return BAD_REQUEST;
+			if (ret == BAD_REQUEST || ret == ENTITY_TOO_LARGE || ret == HEADER_TOO_LARGE) {
+				return ret;
 			}
 			else if (ret == GET_REQUEST) {
 				return doRequest();
@@ -356,8 +734,8 @@ HttpConn::HTTP_CODE HttpConn::processRead()
 			if (ret == GET_REQUEST) {
 				return doRequest();
 			}
-			lineStatus = LINE_OPEN;
-			break;
+			/* Wait for more of the body, parseLine() must not scan it for line ends */
+			return ret;
 		}
 		default:
 		{
@@ -365,214 +743,722 @@ HttpConn::HTTP_CODE HttpConn::processRead()
 		}
 		}
 	}
+	/* The request line and headers are still incomplete, refuse to buffer them without bound */
+	if (m_checkState != CHECK_STATE_CONTENT && m_readIdx - m_requestStart > m_maxHeaderSize) {
+		return HEADER_TOO_LARGE;
+	}
 	return NO_REQUEST;
 }
 
-/* When we get a complete and correct HTTP request, we analyze the properties of the target file. If the target file exists
-  * And it is readable by all users, use mmap to map it to the memory address m_fileAddress, and return success */
+/* When we get a complete and correct HTTP request, we work out the target file. Looking it up on disk is left
+   to a file I/O thread: FILE_PENDING asks the caller to run the task and take its result */
 HttpConn::HTTP_CODE HttpConn::doRequest()
 {
+	/* Full path of the target file, equivalent to the website root directory + m_url */
 	strcpy(m_realFile, m_docRoot);
 	int len = strlen(m_docRoot);
-	
-	const char* p = strrchr(m_url, '/');
+	if (hasParentSegment(m_url)) {
+		return FORBIDDEN_REQUEST;
+	}
 
-	/* Handle CGI */
-	if (m_method == POST) {
-		if (strncasecmp(p + 1, "log.cgi", 7) == 0) {
-			CGI_UserLog();
-		}	
-		else if (strncasecmp(p + 1, "regist.cgi", 10) == 0){
-			CGI_UserRegist();
+	/* Routed endpoints answer by themselves or name the file to serve */
+	Handler handler = routes().find(m_method, m_url);
+	if (handler != nullptr) {
+		/* Handlers may wait on the database, the event loop leaves them to a worker */
+		if (m_onLoop) {
+			return ROUTE_PENDING;
 		}
-		else if (strncasecmp(p + 1, "musiclist.cgi", 13) == 0) {
-			CGI_MusicList();
+		HTTP_CODE ret = (this->*handler)();
+		if (ret != FILE_REQUEST) {
+			return ret;
 		}
 	}
+	/* The bundle answers from memory, only what it does not hold reaches the filesystem */
+	if (findAsset()) {
+		return assetNotModified() ? NOT_MODIFIED : FILE_REQUEST;
+	}
 	strncpy(m_realFile + len, m_url, FILENAME_LEN - len - 1);
+	m_realFile[FILENAME_LEN - 1] = '\0';
+	m_fileTask = TASK_OPEN_FILE;
+	return FILE_PENDING;
+}
 
-	if (stat(m_realFile, &m_fileStat) < 0) {
+/* If the target file exists and it is readable by all users, map it to m_fileAddress or open it for streaming */
+HttpConn::HTTP_CODE HttpConn::openFile()
+{
+	/* Usually answered by the cache without touching the filesystem, missing paths included */
+	shared_ptr<const OpenFile> file = OpenFileCache::getInstance()->lookup(m_realFile);
+	if (file->error != 0) {
 		return NO_RESOURCE;
 	}
+	m_fileStat = file->st;
 
 	if (!(m_fileStat.st_mode & S_IROTH)) {
 		return FORBIDDEN_REQUEST;
 	}
 
+	/* A directory is answered with its listing, built again only after the directory changes */
 	if (S_ISDIR(m_fileStat.st_mode)) {
-		return BAD_REQUEST;
+		/* Only directories that resolve into the root directory are listed, a symbolic link may lead out */
+		if (!underDocRoot(m_realFile)) {
+			return FORBIDDEN_REQUEST;
+		}
+		m_mimeType = &MIME_HTML;
+		m_cachedBody = DirListingCache::getInstance()->get(m_realFile, m_url, m_arena);
+		return m_cachedBody ? FILE_REQUEST : INTERNAL_ERROR;
 	}
 
-	int fd = open(m_realFile, O_RDONLY);
-	m_fileAddress = (char*)mmap(0, m_fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-	close(fd);
-	return FILE_REQUEST;
-}
+	m_mimeType = &mimeTypeOf(m_realFile);
+	/* Text goes out compressed when the client accepts it, media files are compressed already */
+	if (CompressCache::isCompressible(m_realFile)) {
+		m_vary = true;
+		if (m_acceptEncoding != 0 && negotiateEncoding(file)) {
+			return FILE_REQUEST;
+		}
+	}
 
-/* Perform munmap operation on the memory map area */
-void HttpConn::unmap()
-{
-	if (m_fileAddress) {
-		munmap(m_fileAddress, m_fileStat.st_size);
+	/* An empty file has nothing to map */
+	if (m_fileStat.st_size == 0) {
+		return FILE_REQUEST;
+	}
+	if (file->fd == -1) {
+		return NO_RESOURCE;
+	}
+	/* A large file is read window by window, so neither memory nor the page cache traffic of one
+	   response depends on its size. The first window is read ahead here so the worker finds it cached.
+	   The stream gets its own descriptor, the cached one may be dropped while the stream is sent */
+	if (m_fileStat.st_size > STREAM_WINDOW) {
+		int fd = fcntl(file->fd, F_DUPFD_CLOEXEC, 0);
+		if (fd == -1) {
+			return INTERNAL_ERROR;
+		}
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		readahead(fd, 0, STREAM_WINDOW);
+		m_fileFd = fd;
+		return FILE_REQUEST;
+	}
+	/* Fault the pages in here, off the event loop thread, so writev there never waits for the disk */
+	m_fileAddress = (char*)mmap(0, m_fileStat.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, file->fd, 0);
+	if (m_fileAddress == MAP_FAILED) {
 		m_fileAddress = nullptr;
+		return INTERNAL_ERROR;
 	}
+	return FILE_REQUEST;
 }
 
-/* Write HTTP response */
-bool HttpConn::writen()
+bool HttpConn::negotiateEncoding(shared_ptr<const OpenFile>& file)
 {
-	int temp = 0;
-	if (m_bytesToSend == 0) {
-		modfd(m_epollfd, m_sockfd, EPOLLIN, m_mode);
-		init();
-		return true;
-	}
-	
-	while (true) {
-		temp = writev(m_sockfd, m_iv, m_ivCount);
-		if (temp <= -1) {
-			/* If there is no space in the TCP write buffer, wait for the next round of EPOLLOUT events */
-			if (errno == EAGAIN) {
-				modfd(m_epollfd, m_sockfd, EPOLLOUT, m_mode);
-				return true;
-			}
-			unmap();
-			return false;
+	/* A prebuilt sibling such as index.html.br wins unless it is older than the file itself */
+	for (int i = 0; i < 2; ++i) {
+		if (!(m_acceptEncoding & PREFERRED_CODINGS[i])) {
+			continue;
 		}
-
-		m_bytesToSend -= temp;
-		m_bytesHaveSend += temp;
-		/* Solve the problem of transferring large files */
-		if (m_bytesHaveSend >= m_iv[0].iov_len) {
-			m_iv[0].iov_len = 0;
-			m_iv[1].iov_base = m_fileAddress + (m_bytesHaveSend - m_writeIdx);
-			m_iv[1].iov_len = m_bytesToSend;
+		char sibling[FILENAME_LEN];
+		int len = snprintf(sibling, sizeof(sibling), "%s%s", m_realFile, CompressCache::encodingSuffix(PREFERRED_CODINGS[i]));
+		if (len >= FILENAME_LEN) {
+			continue;
 		}
-		else {
-			m_iv[0].iov_base = m_writeBuf + m_bytesHaveSend;
-			m_iv[0].iov_len = m_iv[0].iov_len - m_bytesHaveSend;
+		shared_ptr<const OpenFile> compressed = OpenFileCache::getInstance()->lookup(sibling);
+		if (compressed->fd != -1 && compressed->st.st_mtime >= m_fileStat.st_mtime) {
+			strcpy(m_realFile, sibling);
+			file = compressed;
+			m_fileStat = file->st;
+			m_contentEncoding = PREFERRED_CODINGS[i];
+			return false;
 		}
-
-		/* Send the HTTP response successfully, decide whether to close the connection immediately according to the Connection field in the HTTP request */
-		if (m_bytesToSend <= 0) {
-			unmap();
-			modfd(m_epollfd, m_sockfd, EPOLLIN, m_mode);
-			if (m_linger) {
-				init();
-				return true;
-			}
-			else {
-				return false;
-			}
+	}
+	for (int i = 0; i < 2; ++i) {
+		if (!(m_acceptEncoding & PREFERRED_CODINGS[i])) {
+			continue;
+		}
+		m_cachedBody = CompressCache::getInstance()->get(m_realFile, m_fileStat, PREFERRED_CODINGS[i]);
+		if (m_cachedBody) {
+			m_contentEncoding = PREFERRED_CODINGS[i];
+			return true;
 		}
 	}
+	return false;
 }
 
-/* Write the data to be sent to the write buffer */
-bool HttpConn::addResponse(const char* format, ...)
+bool HttpConn::underDocRoot(const char* path) const
 {
-	if (m_writeIdx >= WRITE_BUFFER_SIZE) {
+	/* The root directory is the same for every connection, resolved once */
+	static const string root = [this]() {
+		char resolved[PATH_MAX];
+		return string(realpath(m_docRoot, resolved) != nullptr ? resolved : m_docRoot);
+	}();
+	char resolved[PATH_MAX];
+	if (realpath(path, resolved) == nullptr) {
 		return false;
 	}
-	va_list argList;
-	va_start(argList, format);
-	int len = vsnprintf(m_writeBuf + m_writeIdx, WRITE_BUFFER_SIZE - 1 - m_writeIdx,
-				        format, argList);
-	if (len >= WRITE_BUFFER_SIZE - 1 - m_writeIdx) {
-		va_end(argList);
+	size_t len = root.size();
+	return strncmp(resolved, root.c_str(), len) == 0 && (resolved[len] == '\0' || resolved[len] == '/');
+}
+
+bool HttpConn::findAsset()
+{
+	m_asset = nullptr;
+	m_bundle = AssetStore::getInstance()->current();
+	if (m_bundle) {
+		m_asset = m_bundle->find(m_url, strlen(m_url));
+	}
+	if (m_asset == nullptr) {
+		m_bundle.reset();
 		return false;
 	}
-	m_writeIdx += len;
-	va_end(argList);
-
-	LOG_INFO("request: %s", m_writeBuf);
+	m_vary = m_asset->vary != 0;
+	m_mimeType = &mimeTypeOf(m_url);
+	for (int i = 0; i < 2; ++i) {
+		if ((m_acceptEncoding & PREFERRED_CODINGS[i]) && m_asset->variants[PREFERRED_CODINGS[i]].length != 0) {
+			m_contentEncoding = PREFERRED_CODINGS[i];
+			break;
+		}
+	}
 	return true;
 }
 
-bool HttpConn::addStatusLine(int status, const char* title)
+bool HttpConn::assetNotModified() const
 {
-	return addResponse("%s %d %s\r\n", "HTTP/1.1", status, title);
+	if (m_ifNoneMatch == nullptr) {
+		return false;
+	}
+	const BundleVariant& variant = m_asset->variants[m_contentEncoding];
+	const char* etag = m_bundle->data(variant.etagOffset);
+	const char* p = m_ifNoneMatch + strspn(m_ifNoneMatch, " \t");
+	/* "*" matches any representation, but only as the whole value */
+	if (*p == '*') {
+		return p[1 + strspn(p + 1, " \t")] == '\0';
+	}
+	/* A comma-separated list of quoted tags, each compared whole; W/ prefixes are ignored since
+	   If-None-Match compares weakly. A tag may hold commas, so the list is split outside the quotes */
+	while (*p != '\0') {
+		p += strspn(p, " \t,");
+		if (strncmp(p, "W/", 2) == 0) {
+			p += 2;
+		}
+		if (*p == '"') {
+			const char* close = strchr(p + 1, '"');
+			if (close == nullptr) {
+				return false;
+			}
+			size_t len = close + 1 - p;
+			const char* next = close + 1 + strspn(close + 1, " \t");
+			if (len == variant.etagLen && memcmp(p, etag, len) == 0 && (*next == ',' || *next == '\0')) {
+				return true;
+			}
+			p = close + 1;
+		}
+		/* Not a quoted tag, skipped up to the next element */
+		p += strcspn(p, ",");
+	}
+	return false;
 }
 
-bool HttpConn::addHeaders(int contentLength)
+int HttpConn::parseAcceptEncoding(const char* text)
 {
-	addContentLength(contentLength);
-	addLinger();
-	addBlankLine();
-	return true;
+	int mask = 0;
+	while (*text != '\0') {
+		text += strspn(text, " \t,");
+		size_t len = strcspn(text, " \t,;");
+		int coding = ENCODING_IDENTITY;
+		if (len == 4 && strncasecmp(text, "gzip", 4) == 0) {
+			coding = ENCODING_GZIP;
+		}
+		else if (len == 2 && strncasecmp(text, "br", 2) == 0) {
+			coding = ENCODING_BROTLI;
+		}
+		/* Only the q parameter matters, q=0 refuses the coding */
+		const char* end = text + strcspn(text, ",");
+		bool refused = false;
+		for (const char* p = text + len; p + 1 < end; ++p) {
+			if ((*p == 'q' || *p == 'Q') && p[1] == '=') {
+				refused = atof(p + 2) <= 0;
+				break;
+			}
+		}
+		if (!refused) {
+			mask |= coding;
+		}
+		text = end;
+	}
+	return mask;
 }
 
-bool HttpConn::addContentLength(int contentLength)
+void HttpConn::runFileTask()
 {
-	return addResponse("Content-Length: %d\r\n", contentLength);
+	switch (m_fileTask) {
+	case TASK_OPEN_FILE:
+		m_taskResult = openFile();
+		break;
+	case TASK_READ_WINDOW:
+		readStreamWindow();
+		break;
+	default:
+		break;
+	}
 }
 
-bool HttpConn::addLinger()
+bool HttpConn::submitFileTask()
 {
-	return addResponse("Connection: %s\r\n", (m_linger == true) ? "keep-alive" : "close");
-}
-
-bool HttpConn::addBlankLine()
+	/* The pool owns the connection until the event loop hands it back to a worker */
+	m_inFileIo.store(true, memory_order_release);
+	if (m_ioPool != nullptr && m_ioPool->submit(this)) {
+		return true;
+	}
+	m_inFileIo.store(false, memory_order_relaxed);
+	/* The filesystem never stalls the event loop, not even when the pool is backed up */
+	if (m_onLoop) {
+		m_taskOnWorker = true;
+		m_passOn = true;
+		return true;
+	}
+	runFileTask();
+	return false;
+}
+
+HttpConn::HTTP_CODE HttpConn::takeFileResult()
+{
+	m_fileTask = TASK_NONE;
+	return m_taskResult;
+}
+
+/* Perform munmap operation on the memory map areas of the current and all queued responses */
+void HttpConn::unmap()
+{
+	if (m_fileAddress) {
+		munmap(m_fileAddress, m_fileStat.st_size);
+		m_fileAddress = nullptr;
+	}
+	if (m_fileFd != -1) {
+		close(m_fileFd);
+		m_fileFd = -1;
+	}
+	for (size_t i = 0; i < m_responses.size(); ++i) {
+		if (m_responses[i].mapped) {
+			munmap(m_responses[i].body, m_responses[i].bodyLen);
+			m_responses[i].mapped = false;
+		}
+	}
+}
+
+/* Write HTTP response */
+bool HttpConn::writen()
 {
-	return addResponse("%s", "\r\n");
+	m_turnWritten = 0;
+	if (m_closing) {
+		return false;
+	}
+	if (m_bytesToSend == 0) {
+		init();
+		park(EPOLLIN);
+		return true;
+	}
+	switch (sendQueued()) {
+	case WRITE_AGAIN:
+		/* If there is no space in the TCP write buffer, wait for the next round of EPOLLOUT events */
+		park(EPOLLOUT);
+		return true;
+	case WRITE_DONE:
+		/* Buffered requests are handed back to process() by the caller instead of waiting for EPOLLIN */
+		if (!hasBufferedRequest()) {
+			park(EPOLLIN);
+		}
+		return true;
+	default:
+		return false;
+	}
+}
+
+HttpConn::WRITE_STATUS HttpConn::sendQueued()
+{
+	int temp = 0;
+	while (true) {
+		/* Yield to the other ready connections, the socket is writable so the event comes right back */
+		if (m_turnWritten >= WRITE_BUDGET) {
+			m_writeBlocked = false;
+			return WRITE_AGAIN;
+		}
+		int count = m_ivCount - m_ivIndex < IOV_MAX ? m_ivCount - m_ivIndex : IOV_MAX;
+		temp = writev(m_sockfd, &m_iv[m_ivIndex], count);
+		m_writeBlocked = temp <= -1 && errno == EAGAIN;
+		if (temp <= -1) {
+			if (errno == EAGAIN) {
+				return WRITE_AGAIN;
+			}
+			unmap();
+			return WRITE_ERROR;
+		}
+
+		m_bytesToSend -= temp;
+		m_bytesHaveSend += temp;
+		m_turnWritten += temp;
+		/* Skip the blocks sent completely and resume inside a partly sent one, large files take several rounds */
+		size_t sent = temp;
+		while (m_ivIndex < m_ivCount && sent >= m_iv[m_ivIndex].iov_len) {
+			sent -= m_iv[m_ivIndex].iov_len;
+			m_ivIndex++;
+		}
+		if (sent > 0) {
+			m_iv[m_ivIndex].iov_base = (char*)m_iv[m_ivIndex].iov_base + sent;
+			m_iv[m_ivIndex].iov_len -= sent;
+		}
+
+		/* All queued responses are sent, close the connection if the last request did not ask to keep it alive */
+		if (m_bytesToSend <= 0) {
+			unmap();
+			if (m_http2 != nullptr) {
+				m_http2->onWriteComplete();
+			}
+			m_responses.clear();
+			m_ivCount = 0;
+			m_ivIndex = 0;
+			m_bytesHaveSend = 0;
+			m_writeBuf.clear();
+			/* The next window of a streamed file is read by process() on a worker, like a buffered request */
+			if (m_streamRemaining > 0) {
+				return WRITE_DONE;
+			}
+			closeFileStream();
+			if (m_closeAfterWrite) {
+				return WRITE_CLOSE;
+			}
+			/* Keep the bytes of pipelined requests that were read but not answered yet */
+			compactReadBuffer();
+			if (m_readIdx == 0) {
+				BufferPool::getInstance()->release(m_readBuf, m_readSize);
+				m_readBuf = nullptr;
+				m_readSize = 0;
+			}
+			return WRITE_DONE;
+		}
+	}
+}
+
+bool HttpConn::writeThrough()
+{
+	/* The last response of a connection goes out from the event loop, which owns closing it */
+	if (!m_writeThrough || m_closeAfterWrite) {
+		park(EPOLLOUT);
+		return false;
+	}
+	switch (sendQueued()) {
+	case WRITE_AGAIN:
+		park(EPOLLOUT);
+		return false;
+	case WRITE_DONE:
+		if (hasBufferedRequest()) {
+			return true;
+		}
+		/* The next request came while this response went out, the event loop left it to this owner */
+		if (m_singleOwner && m_owner.load(memory_order_acquire) == OWNER_NOTIFIED) {
+			m_owner.store(OWNER_HELD, memory_order_release);
+			/* Most often the peer closed after its last request; the loop closes the socket with its timer */
+			if (!readn()) {
+				closeConn();
+				return false;
+			}
+			return true;
+		}
+		park(EPOLLIN);
+		return false;
+	default:
+		closeConn();
+		return false;
+	}
+}
+
+/* Write the data to be sent to the write buffer, it grows by another chunk when full */
+bool HttpConn::addResponse(const char* format, ...)
+{
+	va_list argList;
+	va_start(argList, format);
+	const char* text = m_writeBuf.appendf(format, argList);
+	va_end(argList);
+
+	LOG_INFO("request: %s", text);
+	return true;
+}
+
+bool HttpConn::addStatusLine(int status)
+{
+	size_t len;
+	const char* date = ResponseHead::dateHeader(len);
+	/* An HTTP/2 stream being answered only takes the status, the session encodes the headers */
+	if (m_http2 != nullptr && m_http2->capturing()) {
+		m_http2->setStatus(status);
+		/* The value without "Date: " and the line end */
+		m_http2->addHeader(HpackEncoder::DATE, date + 6, len - 8);
+		return true;
+	}
+	size_t lineLen;
+	const char* line = ResponseHead::statusLine(status, lineLen);
+	m_writeBuf.append(line, lineLen);
+	m_writeBuf.append(date, len);
+	return true;
+}
+
+bool HttpConn::addHeaders(long contentLength)
+{
+	if (m_http2 != nullptr && m_http2->capturing()) {
+		return addContentType();
+	}
+	return addContentType() && addContentLength(contentLength) && addLinger() && addBlankLine();
+}
+
+bool HttpConn::addContentType()
+{
+	if (m_mimeType == nullptr) {
+		return true;
+	}
+	if (m_http2 != nullptr && m_http2->capturing()) {
+		m_http2->addHeader(HpackEncoder::CONTENT_TYPE, m_mimeType->type, m_mimeType->typeLen);
+		return true;
+	}
+	m_writeBuf.append(m_mimeType->header, m_mimeType->headerLen);
+	return true;
+}
+
+bool HttpConn::addContentLength(long contentLength)
+{
+	char line[32 + ResponseHead::MAX_DIGITS] = "Content-Length: ";
+	size_t len = 16 + ResponseHead::formatDecimal(line + 16, contentLength);
+	memcpy(line + len, "\r\n", 2);
+	m_writeBuf.append(line, len + 2);
+	return true;
+}
+
+bool HttpConn::addEncodingHeaders()
+{
+	if (m_http2 != nullptr && m_http2->capturing()) {
+		if (m_contentEncoding != ENCODING_IDENTITY) {
+			const char* name = CompressCache::encodingName(m_contentEncoding);
+			m_http2->addHeader(HpackEncoder::CONTENT_ENCODING, name, strlen(name));
+		}
+		if (m_vary) {
+			m_http2->addHeader(HpackEncoder::VARY, "Accept-Encoding", 15);
+		}
+		return true;
+	}
+	if (m_contentEncoding == ENCODING_BROTLI) {
+		m_writeBuf.append("Content-Encoding: br\r\n", 22);
+	}
+	else if (m_contentEncoding == ENCODING_GZIP) {
+		m_writeBuf.append("Content-Encoding: gzip\r\n", 24);
+	}
+	if (m_vary) {
+		m_writeBuf.append("Vary: Accept-Encoding\r\n", 23);
+	}
+	return true;
+}
+
+bool HttpConn::addAssetHeaders()
+{
+	const BundleVariant& variant = m_asset->variants[m_contentEncoding];
+	if (m_http2 != nullptr && m_http2->capturing()) {
+		m_http2->addHeader(HpackEncoder::ETAG, m_bundle->data(variant.etagOffset), variant.etagLen);
+		return addContentType() && addEncodingHeaders();
+	}
+	/* Content-Length, ETag, Content-Encoding and Vary were formatted when the bundle was packed */
+	m_writeBuf.append(m_bundle->data(variant.headOffset), variant.headLen);
+	return addContentType() && addLinger() && addBlankLine();
+}
+
+bool HttpConn::addLinger()
+{
+	if (!m_linger) {
+		m_writeBuf.append("Connection: close\r\n", 19);
+		return true;
+	}
+	/* HTTP/1.0 clients need the explicit keep-alive, the limits let clients plan their reuse */
+	static const char KEEP_ALIVE[] = "Connection: keep-alive\r\nKeep-Alive: timeout=";
+	char line[sizeof(KEEP_ALIVE) + 2 * ResponseHead::MAX_DIGITS + 8];
+	size_t len = sizeof(KEEP_ALIVE) - 1;
+	memcpy(line, KEEP_ALIVE, len);
+	len += ResponseHead::formatDecimal(line + len, m_idleTimeout);
+	if (m_maxRequests > 0) {
+		memcpy(line + len, ", max=", 6);
+		len += 6;
+		len += ResponseHead::formatDecimal(line + len, m_maxRequests - m_requestCount);
+	}
+	memcpy(line + len, "\r\n", 2);
+	m_writeBuf.append(line, len + 2);
+	return true;
+}
+
+bool HttpConn::addBlankLine()
+{
+	m_writeBuf.append("\r\n", 2);
+	return true;
 }
 
 bool HttpConn::addContent(const char* content)
 {
-	return addResponse("%s", content);
+	if (m_http2 != nullptr && m_http2->capturing()) {
+		m_http2->appendBody(content, strlen(content));
+		return true;
+	}
+	m_writeBuf.append(content, strlen(content));
+	return true;
+}
+
+bool HttpConn::addCanned(int status)
+{
+	const CannedResponse& response = ResponseHead::canned(status);
+	if (m_http2 != nullptr && m_http2->capturing()) {
+		m_mimeType = &MIME_TEXT;
+		addStatusLine(status);
+		addContentType();
+		m_http2->appendBody(response.body, response.bodyLen);
+		return true;
+	}
+	/* Prebuilt but for the date and the connection */
+	size_t len;
+	const char* date = ResponseHead::dateHeader(len);
+	m_writeBuf.append(response.head.data(), response.head.size());
+	m_writeBuf.append(date, len);
+	addLinger();
+	m_writeBuf.append(response.tail.data(), response.tail.size());
+	return true;
+}
+
+bool HttpConn::addStreamHeaders()
+{
+	/* HTTP/2 frames the body itself */
+	if (m_http2 != nullptr && m_http2->capturing()) {
+		return true;
+	}
+	if (!m_http11) {
+		m_linger = false;
+		return addLinger() && addBlankLine();
+	}
+	return addResponse("Transfer-Encoding: chunked\r\n") && addLinger() && addBlankLine();
+}
+
+bool HttpConn::addChunk(const char* data, size_t len)
+{
+	/* An empty chunk would end the body */
+	if (len == 0) {
+		return true;
+	}
+	if (m_http2 != nullptr && m_http2->capturing()) {
+		m_http2->appendBody(data, len);
+		return true;
+	}
+	if (!m_http11) {
+		m_writeBuf.append(data, len);
+		return true;
+	}
+	addResponse("%zx\r\n", len);
+	m_writeBuf.append(data, len);
+	return addBlankLine();
+}
+
+bool HttpConn::addLastChunk()
+{
+	if (m_http2 != nullptr && m_http2->capturing()) {
+		return true;
+	}
+	return !m_http11 || addResponse("0\r\n\r\n");
 }
 
 /* Determine the content returned to the client according to the result of the server processing the HTTP request */
 bool HttpConn::processWrite(HTTP_CODE ret)
 {
+	/* The head of this response follows the heads of the responses already queued */
+	size_t headStart = m_writeBuf.size();
 	switch (ret) {
 		case INTERNAL_ERROR:
 		{
-			addStatusLine(500, ERROR_500_TITLE);
-			addHeaders(strlen(ERROR_500_FORM));
-			if (!addContent(ERROR_500_FORM)) {
+			if (!addCanned(500)) {
 				return false;
 			}
 			break;
 		}
 		case BAD_REQUEST:
 		{
-			addStatusLine(400, ERROR_400_TITLE);
-			addHeaders(strlen(ERROR_400_FORM));
-			if (!addContent(ERROR_400_FORM)) {
+			if (!addCanned(400)) {
+				return false;
+			}
+			break;
+		}
+		case ENTITY_TOO_LARGE:
+		{
+			if (!addCanned(413)) {
+				return false;
+			}
+			break;
+		}
+		case HEADER_TOO_LARGE:
+		{
+			if (!addCanned(431)) {
+				return false;
+			}
+			break;
+		}
+		case DYNAMIC_REQUEST:
+		{
+			if ((this->*m_generator)()) {
+				break;
+			}
+			/* The generator failed before writing anything */
+			if (!addCanned(500)) {
 				return false;
 			}
 			break;
 		}
 		case NO_RESOURCE:
 		{
-			addStatusLine(404, ERROR_404_TITLE);
-			addHeaders(strlen(ERROR_404_FORM));
-			if (!addContent(ERROR_404_FORM)) {
+			if (!addCanned(404)) {
 				return false;
 			}
 			break;
 		}
 		case FORBIDDEN_REQUEST:
 		{
-			addStatusLine(403, ERROR_403_TITLE);
-			addHeaders(strlen(ERROR_403_FORM));
-			if (!addContent(ERROR_403_FORM)) {
+			if (!addCanned(403)) {
+				return false;
+			}
+			break;
+		}
+		case NOT_MODIFIED:
+		{
+			addStatusLine(304);
+			if (!addAssetHeaders()) {
 				return false;
 			}
 			break;
 		}
 		case FILE_REQUEST:
 		{
-			addStatusLine(200, OK_200_TITLE);
+			addStatusLine(200);
+			if (m_asset != nullptr) {
+				if (!addAssetHeaders()) {
+					return false;
+				}
+				queueAsset(headStart);
+				return true;
+			}
+			addEncodingHeaders();
+			if (m_cachedBody) {
+				if (!addHeaders(m_cachedBody->size())) {
+					return false;
+				}
+				queueSharedBody(headStart);
+				return true;
+			}
+			if (m_fileFd != -1) {
+				if (!addHeaders(m_fileStat.st_size)) {
+					return false;
+				}
+				return queueFileStream(headStart);
+			}
 			if (m_fileStat.st_size != 0) {
-				addHeaders(m_fileStat.st_size);
-				m_iv[0].iov_base = m_writeBuf;
-				m_iv[0].iov_len = m_writeIdx;
-				m_iv[1].iov_base = m_fileAddress;
-				m_iv[1].iov_len = m_fileStat.st_size;
-				m_ivCount = 2;
-				m_bytesToSend = m_writeIdx + m_fileStat.st_size;
+				if (!addHeaders(m_fileStat.st_size)) {
+					return false;
+				}
+				/* The queue now owns the mapping */
+				queueResponse(headStart, m_fileAddress, m_fileStat.st_size, true);
+				m_fileAddress = nullptr;
 				return true;
 			}
 			else {
@@ -582,147 +1468,438 @@ bool HttpConn::processWrite(HTTP_CODE ret)
 					return false;
 				}
 			}
+			break;
 		}
 		default:
 		{
 			return false;
 		}
 	}
-	m_iv[0].iov_base = m_writeBuf;
-	m_iv[0].iov_len = m_writeIdx;
-	m_ivCount = 1;
-	m_bytesToSend = m_writeIdx;
+	queueResponse(headStart, nullptr, 0, false);
 	return true;
 }
 
-/* Called by the worker thread in the thread pool, this is the entry function for processing HTTP requests */
-void HttpConn::process()
+void HttpConn::queueResponse(size_t headStart, char* body, size_t bodyLen, bool mapped)
 {
-	HTTP_CODE readRet = processRead();
-	if (readRet == NO_REQUEST) {
-		modfd(m_epollfd, m_sockfd, EPOLLIN, m_mode);
+	/* The body of an HTTP/2 stream is framed later by the session */
+	if (m_http2 != nullptr && m_http2->capturing()) {
+		if (body != nullptr) {
+			m_http2->setFileBody(body, bodyLen);
+		}
 		return;
 	}
-	bool writeRet = processWrite(readRet);
-	if (!writeRet) {
-		closeConn();
+	PendingResponse response;
+	response.headStart = headStart;
+	response.headLen = m_writeBuf.size() - headStart;
+	response.body = body;
+	response.bodyLen = bodyLen;
+	response.mapped = mapped;
+	m_responses.push_back(response);
+}
+
+void HttpConn::queueSharedBody(size_t headStart)
+{
+	shared_ptr<const string> body = m_cachedBody;
+	m_cachedBody.reset();
+	if (m_http2 != nullptr && m_http2->capturing()) {
+		m_http2->setSharedBody(body->data(), body->size(), body);
+		return;
 	}
-	modfd(m_epollfd, m_sockfd, EPOLLOUT, m_mode);
+	queueResponse(headStart, (char*)body->data(), body->size(), false);
+	m_responses.back().hold = body;
 }
 
-void HttpConn::CGI_UserLog()
+void HttpConn::queueAsset(size_t headStart)
 {
-	/* First parse the username and password from the request body content */
-	string name, password;
-	getNameAndPwd(name, password);
-	if (m_users.find(name) != m_users.end() && m_users[name] == password) {
-		strcpy(m_url, "/welcome.html");
+	const BundleVariant& variant = m_asset->variants[m_contentEncoding];
+	const char* body = m_bundle->data(variant.offset);
+	if (m_http2 != nullptr && m_http2->capturing()) {
+		m_http2->setSharedBody(body, variant.length, m_bundle);
+		return;
 	}
-	else {
-		strcpy(m_url, "/logError.html");
+	queueResponse(headStart, (char*)body, variant.length, false);
+	m_responses.back().hold = m_bundle;
+}
+
+bool HttpConn::queueFileStream(size_t headStart)
+{
+	int fd = m_fileFd;
+	m_fileFd = -1;
+	if (m_http2 != nullptr && m_http2->capturing()) {
+		m_http2->setFileStream(fd, m_fileStat.st_size);
+		return true;
 	}
+	m_streamFd = fd;
+	m_streamOffset = 0;
+	m_streamRemaining = m_fileStat.st_size;
+	m_streamBufSize = STREAM_WINDOW;
+	m_streamBuf = BufferPool::getInstance()->acquire(m_streamBufSize);
+	/* Read ahead when the file was opened, so this is a page cache copy */
+	readStreamWindow();
+	return queueStreamWindow(headStart);
 }
 
-void HttpConn::CGI_UserRegist()
+void HttpConn::readStreamWindow()
 {
-	/* First parse the username and password from the request body content */
-	string name, password;
-	getNameAndPwd(name, password);
-	/* First check if there is a duplicate name in the database */
-	/* If there is no duplicate name, insert it directly */
-	if (m_users.find(name) == m_users.end()) {
-		char sql[200] = { 0 };
-		sprintf(sql, "INSERT INTO user(username, passwd) VALUES('%s', '%s');", name.c_str(), password.c_str());
-		m_lock.lock();
-		int res = mysql_query(m_mysql, sql);
-		m_users[name] = password;
-		m_lock.unlock();
-		if (!res) {
-			strcpy(m_url, "/log.html");
+	size_t len = m_streamRemaining < m_streamBufSize ? m_streamRemaining : m_streamBufSize;
+	m_taskBytes = pread(m_streamFd, m_streamBuf, len, m_streamOffset);
+}
+
+bool HttpConn::queueStreamWindow(size_t headStart)
+{
+	ssize_t n = m_taskBytes;
+	/* The file shrank under us, the promised Content-Length can no longer be met */
+	if (n <= 0) {
+		LOG_ERROR("pread error, errno is %d", errno);
+		closeFileStream();
+		return false;
+	}
+	m_streamOffset += n;
+	m_streamRemaining -= n;
+	/* Let the kernel read the next window while this one is being sent */
+	if (m_streamRemaining > 0) {
+		posix_fadvise(m_streamFd, m_streamOffset, m_streamBufSize, POSIX_FADV_WILLNEED);
+	}
+	queueResponse(headStart, m_streamBuf, n, false);
+	return true;
+}
+
+void HttpConn::closeFileStream()
+{
+	if (m_streamFd != -1) {
+		close(m_streamFd);
+		m_streamFd = -1;
+	}
+	if (m_streamBuf != nullptr) {
+		BufferPool::getInstance()->release(m_streamBuf, m_streamBufSize);
+		m_streamBuf = nullptr;
+		m_streamBufSize = 0;
+	}
+	m_streamRemaining = 0;
+}
+
+void HttpConn::park(int ev)
+{
+	if (!m_singleOwner) {
+		modfd(m_epollfd, m_sockfd, ev, m_mode);
+		return;
+	}
+	/* The socket stays registered for both directions. An edge may have been missed when it is not known
+	   to come: bytes left unread, a read edge passed over while waiting to write, or a write parked before
+	   the socket ever filled up */
+	bool missed = ev == EPOLLIN ? m_waitWrite || !m_readDrained : !m_writeBlocked;
+	m_waitWrite = ev == EPOLLOUT;
+	int sockfd = m_sockfd;
+	/* Events that came while the connection was held were left to this owner */
+	if (m_owner.exchange(OWNER_NONE, memory_order_acq_rel) == OWNER_NOTIFIED || missed) {
+		repollfd(m_epollfd, sockfd);
+	}
+}
+
+uint32_t HttpConn::claim(uint32_t events)
+{
+	if (!m_singleOwner) {
+		return events;
+	}
+	int state = m_owner.load(memory_order_acquire);
+	while (true) {
+		if (state == OWNER_NONE) {
+			if (m_owner.compare_exchange_weak(state, OWNER_HELD, memory_order_acq_rel)) {
+				break;
+			}
 		}
-		else {
-			strcpy(m_url, "/registError.html");
+		else if (state == OWNER_NOTIFIED || m_owner.compare_exchange_weak(state, OWNER_NOTIFIED, memory_order_acq_rel)) {
+			return 0;
 		}
 	}
-	else {
-		strcpy(m_url, "/registError.html");
+	/* Only the direction the connection waits for is handled, a read edge passed over while waiting to
+	   write is looked at again once the write is done */
+	events &= m_waitWrite ? ~(uint32_t)EPOLLIN : ~(uint32_t)EPOLLOUT;
+	if (!(events & (EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+		m_owner.store(OWNER_NONE, memory_order_release);
+		return 0;
 	}
+	return events;
 }
 
-int HttpConn::getNameAndPwd(string& name, string& password)
+void HttpConn::prepareWrite()
 {
-    // user=123&password=123
-	int i;
-	for (i = 5; m_namePassword[i] != '&'; ++i) {
-		name.push_back(m_namePassword[i]);
+	m_iv.clear();
+	m_ivIndex = 0;
+	m_bytesToSend = 0;
+	m_bytesHaveSend = 0;
+	for (size_t i = 0; i < m_responses.size(); ++i) {
+		const PendingResponse& response = m_responses[i];
+		/* Heads of consecutive responses without a file body are adjacent in the write buffer and share one block */
+		m_writeBuf.fill(response.headStart, response.headLen, m_iv);
+		if (response.bodyLen != 0) {
+			iovec body = { response.body, response.bodyLen };
+			m_iv.push_back(body);
+		}
+		m_bytesToSend += response.headLen + response.bodyLen;
 	}
-	for (i = i + 10; i < m_namePassword.length(); ++i) {
-		password.push_back(m_namePassword[i]);
+	m_ivCount = m_iv.size();
+}
+
+/* Called by the worker thread in the thread pool, this is the entry function for processing HTTP requests.
+   Every complete request already in the read buffer is answered, and the responses are written together */
+void HttpConn::process()
+{
+	m_turnWritten = 0;
+	/* Once the responses are written through, no event is left to resume the requests buffered behind them */
+	while (processOnce()) {
 	}
-	return true;
 }
 
-void HttpConn::CGI_MusicList()
+bool HttpConn::processOnLoop()
 {
-	char tempBuf[BUFSIZ] = { 0 };
-	int len = 0;
-	/* Read the header of the html file */
-	int fd = open("root/dir_header.html", O_RDONLY);
-	if (fd == -1) {
-		LOG_ERROR("CGI_MusicList open error, errno is %d", errno);
-		return;
+	/* Filesystem work stays off the loop only with the file I/O pool. HTTP/2 answers its streams with the
+	   filesystem work done in place */
+	if (!m_inlineStatic || m_ioPool == nullptr || m_http2 != nullptr || startsWithPreface()) {
+		return false;
 	}
-	size_t headerLen = read(fd, tempBuf, sizeof(tempBuf));
-	if (headerLen == -1) {
-		LOG_ERROR("CGI_MusicList read error, errno is %d", errno);
-		return;
+	m_passOn = false;
+	process();
+	/* Not parked when passed on, so nobody else holds the connection yet */
+	return !m_passOn;
+}
+
+bool HttpConn::startsWithPreface() const
+{
+	if (m_requestCount != 0 || m_readIdx == 0) {
+		return false;
 	}
-	close(fd);
-	len += headerLen;
+	int len = m_readIdx < Http2Session::PREFACE_LEN ? m_readIdx : Http2Session::PREFACE_LEN;
+	return memcmp(m_readBuf, Http2Session::PREFACE, len) == 0;
+}
 
-	/* Query all information under the music folder */
-	struct dirent** nameList;
-	int num = scandir("root/music", &nameList, nullptr, alphasort);
-	if (num < 0) {
-		LOG_ERROR("CGI_MusicList scandir error, errno is %d", errno);
-		return;
+bool HttpConn::processOnce()
+{
+	if (m_taskOnWorker) {
+		m_taskOnWorker = false;
+		runFileTask();
 	}
-	/* Write all file connections under the music folder into the buffer */
-	while (num--) {
-		if (nameList[num]->d_name[0] == '.') {
-			continue;
+	/* A streamed file holds back the pipelined responses behind it until its last window is queued */
+	if (m_streamRemaining > 0) {
+		if (m_fileTask == TASK_NONE) {
+			m_fileTask = TASK_READ_WINDOW;
+			if (submitFileTask()) {
+				return false;
+			}
 		}
-		int n = snprintf(tempBuf + len, BUFSIZ - len, "<li><a href=music/%s>%s</a></li>\n", nameList[num]->d_name, nameList[num]->d_name);
-		len += n;
-		free(nameList[num]);
+		m_fileTask = TASK_NONE;
+		if (!queueStreamWindow(0)) {
+			closeConn();
+			return false;
+		}
+		prepareWrite();
+		return writeThrough();
 	}
-	free(nameList);
+	/* A client with prior knowledge of HTTP/2 opens with the connection preface instead of a request line */
+	if (m_http2 == nullptr && startsWithPreface()) {
+		if (m_readIdx < Http2Session::PREFACE_LEN) {
+			park(EPOLLIN);
+			return false;
+		}
+		m_http2 = new Http2Session(this);
+	}
+	while (m_http2 == nullptr && m_responses.size() < MAX_PIPELINE && !m_closeAfterWrite && m_streamRemaining == 0) {
+		HTTP_CODE readRet;
+		/* Resumed by the event loop once the file I/O pool finished the request's filesystem work */
+		if (m_fileTask != TASK_NONE) {
+			readRet = takeFileResult();
+		}
+		/* Resumed on a worker after the event loop passed the request on */
+		else if (m_routePending) {
+			m_routePending = false;
+			readRet = doRequest();
+		}
+		else {
+			readRet = processRead();
+		}
+		if (readRet == NO_REQUEST) {
+			break;
+		}
+		/* The responses queued so far go out together with this one from the worker */
+		if (readRet == ROUTE_PENDING) {
+			m_routePending = true;
+			m_passOn = true;
+			return false;
+		}
+		/* Parked without any epoll event armed, the queued responses go out together with this one */
+		if (readRet == FILE_PENDING) {
+			if (submitFileTask()) {
+				return false;
+			}
+			readRet = takeFileResult();
+		}
+		/* The parser cannot find the next request after a malformed or refused one */
+		if (readRet == BAD_REQUEST || readRet == ENTITY_TOO_LARGE || readRet == HEADER_TOO_LARGE) {
+			m_linger = false;
+		}
+		/* The last request allowed on this connection is answered with Connection: close */
+		if (++m_requestCount >= m_maxRequests && m_maxRequests > 0) {
+			m_linger = false;
+		}
+		/* Upgrade to cleartext HTTP/2: 101, then the answer to this request goes out as stream 1 */
+		if (m_upgradeH2c && m_http11 && m_linger && !m_h2Settings.empty()) {
+			size_t headStart = m_writeBuf.size();
+			addResponse("HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n");
+			queueResponse(headStart, nullptr, 0, false);
+			m_http2 = new Http2Session(this);
+			m_http2->upgrade(m_h2Settings, readRet);
+			resetRequest();
+			break;
+		}
+		if (!processWrite(readRet)) {
+			closeConn();
+			return false;
+		}
+		m_closeAfterWrite = !m_linger;
+		resetRequest();
+	}
+	if (m_http2 != nullptr) {
+		/* Upgraded to HTTP/2 on the event loop, the streams are answered by a worker */
+		if (m_onLoop) {
+			m_passOn = true;
+			return false;
+		}
+		m_http2->process();
+		m_closeAfterWrite = m_http2->isClosing();
+	}
+	if (m_responses.empty()) {
+		/* The peer said GOAWAY and every stream is answered */
+		if (m_closeAfterWrite) {
+			closeConn();
+			return false;
+		}
+		park(EPOLLIN);
+		return false;
+	}
+	prepareWrite();
+	return writeThrough();
+}
 
-	/* Read the end of the html file */
-	fd = open("root/dir_tail.html", O_RDONLY);
-	if (fd == -1) {
-		LOG_ERROR("CGI_MusicList open error, errno is %d", errno);
-		return;
+
+
+const Router<HttpConn::Handler>& HttpConn::routes()
+{
+	static const Route<Handler> table[] = {
+		ROUTE(POST, "/log.cgi", &HttpConn::CGI_UserLog),
+		ROUTE(POST, "/regist.cgi", &HttpConn::CGI_UserRegist),
+		ROUTE(POST, "/musiclist.cgi", &HttpConn::CGI_MusicList),
+	};
+	static const Router<Handler> router(table, sizeof(table) / sizeof(table[0]));
+	return router;
+}
+
+HttpConn::HTTP_CODE HttpConn::CGI_UserLog()
+{
+	/* First parse the username and password from the request body content */
+	StringSlice name, password;
+	m_url = "/logError.html";
+	if (!getNameAndPwd(name, password)) {
+		return FILE_REQUEST;
 	}
-	size_t tailLen = read(fd, tempBuf + len, sizeof(tempBuf) - len);
-	if (tailLen == -1) {
-		LOG_ERROR("CGI_MusicList read error, errno is %d", errno);
-		return;
+	auto user = m_users.find(string(name.data, name.len));
+	if (user != m_users.end() && user->second.size() == password.len
+		&& memcmp(user->second.data(), password.data, password.len) == 0) {
+		/* The page greets the user when its template is installed, otherwise it is the static one */
+		m_page = TemplateStore::getInstance()->get("welcome");
+		if (m_page) {
+			m_userName = name;
+			m_generator = &HttpConn::CGI_Welcome;
+			return DYNAMIC_REQUEST;
+		}
+		m_url = "/welcome.html";
 	}
-	close(fd);
-	len += tailLen;
-	/* generate dynamic html file */
-	FILE* fp = fopen("root/musiclist.html", "w+");
-	if (fp == nullptr) {
-		LOG_ERROR("CGI_MusicList open error, errno is %d", errno);
-		return;
+	return FILE_REQUEST;
+}
+
+HttpConn::HTTP_CODE HttpConn::CGI_UserRegist()
+{
+	/* First parse the username and password from the request body content */
+	StringSlice name, password;
+	m_url = "/registError.html";
+	if (!getNameAndPwd(name, password) || !isPlainText(name) || !isPlainText(password)) {
+		return FILE_REQUEST;
 	}
-	int ret = fputs(tempBuf, fp);
-	if (ret == EOF) {
-		LOG_ERROR("CGI_MusicList open error, errno is %d", errno);
-		return;
+	/* Decoded fields may hold quotes, they are escaped into the arena: at worst two bytes for each */
+	char* escapedName = (char*)m_arena.allocate(name.len * 2 + 1, 1);
+	char* escapedPassword = (char*)m_arena.allocate(password.len * 2 + 1, 1);
+	unsigned long nameLen = mysql_real_escape_string(m_mysql, escapedName, name.data, name.len);
+	unsigned long passwordLen = mysql_real_escape_string(m_mysql, escapedPassword, password.data, password.len);
+	char sql[MAX_SQL_SIZE];
+	int sqlLen = snprintf(sql, sizeof(sql), "INSERT INTO user(username, passwd) VALUES('%.*s', '%.*s');",
+						  (int)nameLen, escapedName, (int)passwordLen, escapedPassword);
+	/* A cut-off statement is never run */
+	if (sqlLen < 0 || (size_t)sqlLen >= sizeof(sql)) {
+		return FILE_REQUEST;
 	}
-	fflush(fp);
-	fclose(fp);
-	strcpy(m_url, "/musiclist.html");
-}
\ No newline at end of file
+	/* First check if there is a duplicate name in the database */
+	/* If there is no duplicate name, insert it directly */
+	string key(name.data, name.len);
+	if (m_users.find(key) == m_users.end()) {
+		m_lock.lock();
+		int res = mysql_query(m_mysql, sql);
+		m_users[key] = string(password.data, password.len);
+		m_lock.unlock();
+		if (!res) {
+			m_url = "/log.html";
+		}
+	}
+	return FILE_REQUEST;
+}
+
+/* The music list is the listing of the music folder */
+HttpConn::HTTP_CODE HttpConn::CGI_MusicList()
+{
+	m_url = "/music";
+	return FILE_REQUEST;
+}
+
+bool HttpConn::CGI_Welcome()
+{
+	TemplateValue vars[Template::MAX_NAMES];
+	TemplateRows loops[Template::MAX_NAMES];
+	for (size_t i = 0; i < Template::MAX_NAMES; ++i) {
+		vars[i] = TemplateValue{ "", 0 };
+		loops[i] = TemplateRows{ nullptr, 0, 0 };
+	}
+	int user = m_page->variable("user");
+	if (user != -1) {
+		vars[user] = TemplateValue{ m_userName.data, m_userName.len };
+	}
+	/* Rendered straight into the response, after headers that already know its length */
+	m_mimeType = &MIME_HTML;
+	addStatusLine(200);
+	if (!addHeaders(m_page->measure(vars, loops))) {
+		return false;
+	}
+	auto append = [this](const char* data, size_t len) {
+		if (m_http2 != nullptr && m_http2->capturing()) {
+			m_http2->appendBody(data, len);
+		}
+		else {
+			m_writeBuf.append(data, len);
+		}
+	};
+	m_page->render(vars, loops, append);
+	return true;
+}
+
+void HttpConn::stripQuery(char* target)
+{
+	char* query = strchr(target, '?');
+	if (query != nullptr) {
+		*query = '\0';
+	}
+}
+
+bool HttpConn::getNameAndPwd(StringSlice& name, StringSlice& password)
+{
+	/* user=123&password=123, decoded in place */
+	FormParser form;
+	form.parse(m_body, m_bodyLen);
+	return form.get("user", name) && form.get("password", password);
+}
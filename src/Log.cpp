@@ -1,7 +1,16 @@
 #include <iostream>
+#include <algorithm>
+#include <vector>
 #include <pthread.h>
 #include <cstring>
 #include <ctime>
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <zlib.h>
 #include "Log.h"
 using namespace std;
 
@@ -19,10 +28,31 @@ void* Log::flushLogThread(void* arg)
 	return nullptr;
 }
 
+/* Callback function for the rotation thread */
+void* Log::rotateLogThread(void* arg)
+{
+	Log::getInstance()->rotateLog();
+	return nullptr;
+}
+
 Log::Log()
 {
 	m_count = 0;
+	m_bytes = 0;
+	m_openTime = 0;
+	m_splitBytes = 0;
+	m_splitSeconds = 0;
+	m_keepFiles = 0;
+	m_rotatePending = false;
+	m_splitIndex = 0;
+	m_fileName[0] = '\0';
 	m_isAsync = false;
+	m_isRing = false;
+	m_fp = nullptr;
+	m_buf = nullptr;
+	m_logQueue = nullptr;
+	m_dirName[0] = '\0';
+	m_logName[0] = '\0';
 }
 
 Log::~Log()
@@ -42,21 +72,17 @@ Log::~Log()
 }
 
 /* Asynchronous mode requires setting the block queue length, synchronous mode does not require setting it */
-bool Log::init(const char* fileName, int closeLog, int logBufSize, int splitLines, int maxQueueSize)
+bool Log::init(const char* fileName, int closeLog, int logBufSize, int splitLines, int maxQueueSize, int ringSize,
+			long long splitBytes, int splitSeconds, int keepFiles)
 {
-	/* If the block queue length is set, set it as asynchronous */
-	if (maxQueueSize > 0) {
-		m_isAsync = true;
-		m_logQueue = new BlockQueue<string>(maxQueueSize);
-		pthread_t tid;
-		pthread_create(&tid, nullptr, flushLogThread, nullptr);
-	}
-
 	m_closeLog = closeLog;
 	m_logBufSize = logBufSize;
 	m_buf = new char[m_logBufSize];
 	memset(m_buf, '\0', m_logBufSize);
-	m_spiltLines = splitLines;
+	m_spiltLines = splitLines > 0 ? splitLines : 5000000;
+	m_splitBytes = splitBytes;
+	m_splitSeconds = splitSeconds;
+	m_keepFiles = keepFiles;
 
 	time_t t = time(nullptr);
 	struct tm* sysTm = localtime(&t);
@@ -67,21 +93,46 @@ bool Log::init(const char* fileName, int closeLog, int logBufSize, int splitLine
 	char logFullName[301] = { 0 };
 
 	if (p == nullptr) {
+		strncpy(m_logName, fileName, sizeof(m_logName) - 1);
 		snprintf(logFullName, 300, "%d_%02d_%02d_%s", myTm.tm_year + 1900, 
 				myTm.tm_mon + 1, myTm.tm_mday, fileName);
 	}
 	else {
 		strcpy(m_logName, p + 1);
 		strncpy(m_dirName, fileName, p - fileName + 1);
+		m_dirName[p - fileName + 1] = '\0';
 		snprintf(logFullName, 300, "%s%d_%02d_%02d_%s", m_dirName, myTm.tm_year + 1900, 
 				myTm.tm_mon + 1, myTm.tm_mday, m_logName);	
 	}
 	m_today = myTm.tm_mday;
 
+	/* The ring keeps one fixed name across daily and size splits so the decoder always finds it */
+	if (ringSize > 0) {
+		char ringName[301] = { 0 };
+		snprintf(ringName, 300, "%s%s.ring", m_dirName, m_logName);
+		m_isRing = m_ring.open(ringName, ringSize);
+	}
+
 	m_fp = fopen(logFullName, "a");
 	if (m_fp == nullptr) {
 		return false;
 	}
+	strcpy(m_fileName, logFullName);
+	m_openTime = t;
+	/* Appending to an existing file of today counts towards its size limit */
+	m_bytes = ftell(m_fp);
+
+	pthread_t tid;
+	/* If the block queue length is set, set it as asynchronous */
+	if (maxQueueSize > 0) {
+		m_isAsync = true;
+		m_logQueue = new MpmcChannel<string>(maxQueueSize);
+		pthread_create(&tid, nullptr, flushLogThread, nullptr);
+		pthread_detach(tid);
+	}
+	/* Files are swapped and compressed by a background thread so no request thread ever waits on fopen/fclose */
+	pthread_create(&tid, nullptr, rotateLogThread, nullptr);
+	pthread_detach(tid);
 	return true;
 }
 
@@ -113,27 +164,6 @@ void Log::writeLog(Level level, const char* format, ...)
 		break;
 	}
 
-	/* Write a log and increment m_count */
-	m_mutex.lock();
-	m_count++;
-	if (m_today != myTm.tm_mday || m_count % m_spiltLines == 0) {
-		char newLog[301] = { 0 };
-		fflush(m_fp);
-		fclose(m_fp);
-		char tail[16] = { 0 };
-		snprintf(tail, 16, "%d_%02d_%02d_", myTm.tm_year + 1900, myTm.tm_mon + 1, myTm.tm_mday);
-		if (m_today != myTm.tm_mday) {
-			snprintf(newLog, 300, "%s%s%s", m_dirName, tail, m_logName);
-			m_today = myTm.tm_mday;
-			m_count = 0;
-		}
-		else {
-			snprintf(newLog, 300, "%s%s%s.%lld", m_dirName, tail, m_logName, m_count / m_spiltLines);
-		}
-		m_fp = fopen(newLog, "a");
-	}
-	m_mutex.unlock();
-
 	va_list valst;
 	va_start(valst, format);
 	string logStr;
@@ -142,19 +172,23 @@ void Log::writeLog(Level level, const char* format, ...)
 	int n = snprintf(m_buf, 48, "%d-%02d-%02d %02d:%02d:%02d.%06ld %s",
             myTm.tm_year + 1900, myTm.tm_mon + 1, myTm.tm_mday,
             myTm.tm_hour, myTm.tm_min, myTm.tm_sec, now.tv_usec, s);
-	int m = vsnprintf(m_buf + n, m_logBufSize - 1, format, valst);
+	int m = vsnprintf(m_buf + n, m_logBufSize - n - 1, format, valst);
+	/* Keep room for the newline when the message was truncated */
+	if (m > m_logBufSize - n - 2) {
+		m = m_logBufSize - n - 2;
+	}
 	m_buf[n + m] = '\n';
 	m_buf[n + m + 1] = '\0';
 	logStr = m_buf;
 	m_mutex.unlock();
 
-	if (m_isAsync && !m_logQueue->isFull()) {
-		m_logQueue->push(logStr);
+	if (m_isRing) {
+		m_ring.append(logStr.c_str(), logStr.size());
 	}
-	else {
-		m_mutex.lock();
-		fputs(logStr.c_str(), m_fp);
-		m_mutex.unlock();
+
+	/* The string is only moved into the queue if it fits, otherwise it is written synchronously */
+	if (!m_isAsync || !m_logQueue->tryPush(std::move(logStr))) {
+		writeToFile(&logStr, 1);
 	}
 
 	va_end(valst);
@@ -162,6 +196,9 @@ void Log::writeLog(Level level, const char* format, ...)
 
 void Log::flush(void)
 {
+	if (m_isRing) {
+		return;
+	}
 	m_mutex.lock();
 	fflush(m_fp);
 	m_mutex.unlock();
@@ -169,12 +206,210 @@ void Log::flush(void)
 
 void* Log::asyncWriteLog()
 {
-	string singleLog;
-	/* Take a log string from the blocking queue and write it to a file */
-	while (m_logQueue->pop(singleLog)) {
+	string logs[64];
+	size_t n = 0;
+	/* Take a batch of log strings from the queue and write them to the file under one lock */
+	while ((n = m_logQueue->pop_n(logs, 64)) > 0) {
+		writeToFile(logs, n);
+	}
+	return nullptr;
+}
+
+void Log::writeToFile(const string* lines, int n)
+{
+	m_mutex.lock();
+	for (int i = 0; i < n; ++i) {
+		fputs(lines[i].c_str(), m_fp);
+		m_bytes += lines[i].size();
+	}
+	m_count += n;
+	bool wake = !m_rotatePending && (m_count >= m_spiltLines || (m_splitBytes > 0 && m_bytes >= m_splitBytes));
+	if (wake) {
+		m_rotatePending = true;
+	}
+	m_mutex.unlock();
+	if (wake) {
+		m_rotateCond.signal();
+	}
+}
+
+void* Log::rotateLog()
+{
+	/* Compression must not compete with request threads for CPU */
+	setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+	scanRotated();
+	prune();
+
+	while (true) {
 		m_mutex.lock();
-		fputs(singleLog.c_str(), m_fp);
+		if (!m_rotatePending) {
+			/* Wake up at least once a second for the daily and age limits */
+			struct timespec t = { 0, 0 };
+			clock_gettime(CLOCK_REALTIME, &t);
+			t.tv_sec += 1;
+			m_rotateCond.timeWait(m_mutex.get(), t);
+		}
+		bool pending = m_rotatePending;
+		int today = m_today;
+		time_t openTime = m_openTime;
 		m_mutex.unlock();
+
+		time_t t = time(nullptr);
+		struct tm myTm;
+		localtime_r(&t, &myTm);
+		if (pending || myTm.tm_mday != today || (m_splitSeconds > 0 && t - openTime >= m_splitSeconds)) {
+			rotate(myTm);
+		}
 	}
 	return nullptr;
-}
\ No newline at end of file
+}
+
+void Log::rotate(const struct tm& now)
+{
+	char newLog[301] = { 0 };
+	snprintf(newLog, 300, "%s%d_%02d_%02d_%s", m_dirName, now.tm_year + 1900,
+			now.tm_mon + 1, now.tm_mday, m_logName);
+
+	/* A new day starts a new dated file, a split within the day moves the full file aside as name.N */
+	string rotated = m_fileName;
+	if (now.tm_mday == m_today) {
+		char splitLog[320] = { 0 };
+		/* Indexes only grow within a day so that retention always removes the oldest split */
+		while (true) {
+			snprintf(splitLog, sizeof(splitLog), "%s.%d", m_fileName, ++m_splitIndex);
+			string gz = string(splitLog) + ".gz";
+			if (access(splitLog, F_OK) != 0 && access(gz.c_str(), F_OK) != 0) {
+				break;
+			}
+		}
+		/* Writers keep appending through the open stream, which follows the renamed file until the swap */
+		if (rename(m_fileName, splitLog) != 0) {
+			rotateFailed();
+			return;
+		}
+		rotated = splitLog;
+	}
+
+	FILE* fp = fopen(newLog, "a");
+	if (fp == nullptr) {
+		rotateFailed();
+		return;
+	}
+	m_mutex.lock();
+	FILE* old = m_fp;
+	m_fp = fp;
+	if (now.tm_mday != m_today) {
+		m_splitIndex = 0;
+	}
+	m_count = 0;
+	m_bytes = ftell(fp);
+	m_today = now.tm_mday;
+	m_openTime = time(nullptr);
+	m_rotatePending = false;
+	m_mutex.unlock();
+
+	strcpy(m_fileName, newLog);
+	fclose(old);
+	m_rotated.push_back(compress(rotated) ? rotated + ".gz" : rotated);
+	prune();
+}
+
+void Log::rotateFailed()
+{
+	/* Keep writing to the current file and retry once the limit is hit again, instead of spinning */
+	m_mutex.lock();
+	m_rotatePending = false;
+	m_count = 0;
+	m_bytes = 0;
+	m_openTime = time(nullptr);
+	m_mutex.unlock();
+	LOG_ERROR("log rotation of %s failed, errno is %d", m_fileName, errno);
+}
+
+bool Log::compress(const string& path)
+{
+	FILE* in = fopen(path.c_str(), "rb");
+	if (in == nullptr) {
+		return false;
+	}
+	string gzPath = path + ".gz";
+	string tmpPath = gzPath + ".tmp";
+	gzFile out = gzopen(tmpPath.c_str(), "wb6");
+	if (out == nullptr) {
+		fclose(in);
+		return false;
+	}
+
+	vector<char> buf(64 * 1024);
+	size_t n = 0;
+	bool ok = true;
+	while ((n = fread(buf.data(), 1, buf.size(), in)) > 0) {
+		if (gzwrite(out, buf.data(), n) != (int)n) {
+			ok = false;
+			break;
+		}
+	}
+	fclose(in);
+	if (gzclose(out) != Z_OK || !ok) {
+		unlink(tmpPath.c_str());
+		return false;
+	}
+	/* Readers see either the old file or the complete archive, never a partial one */
+	rename(tmpPath.c_str(), gzPath.c_str());
+	unlink(path.c_str());
+	return true;
+}
+
+void Log::prune()
+{
+	while (m_keepFiles > 0 && (int)m_rotated.size() > m_keepFiles) {
+		unlink(m_rotated.front().c_str());
+		m_rotated.pop_front();
+	}
+}
+
+void Log::scanRotated()
+{
+	const char* dir = m_dirName[0] ? m_dirName : "./";
+	const char* current = strrchr(m_fileName, '/');
+	current = current ? current + 1 : m_fileName;
+	size_t nameLen = strlen(m_logName);
+
+	DIR* dp = opendir(dir);
+	if (dp == nullptr) {
+		return;
+	}
+	/* Rotated files look like YYYY_MM_DD_<name>, YYYY_MM_DD_<name>.N or either of them with .gz */
+	vector<pair<time_t, string> > found;
+	struct dirent* entry = nullptr;
+	while ((entry = readdir(dp)) != nullptr) {
+		const char* name = entry->d_name;
+		if (strlen(name) < 11 + nameLen || strcmp(name, current) == 0
+			|| strspn(name, "0123456789_") < 11 || strncmp(name + 11, m_logName, nameLen) != 0) {
+			continue;
+		}
+		const char* suffix = name + 11 + nameLen;
+		if (suffix[0] != '\0' && (suffix[0] != '.' || strcmp(suffix, ".ring") == 0
+			|| strstr(suffix, ".tmp") != nullptr)) {
+			continue;
+		}
+		string path = string(m_dirName) + name;
+		struct stat st;
+		if (stat(path.c_str(), &st) == 0) {
+			found.push_back(make_pair(st.st_mtime, path));
+		}
+	}
+	closedir(dp);
+
+	sort(found.begin(), found.end());
+	for (size_t i = 0; i < found.size(); ++i) {
+		string path = found[i].second;
+		/* Leftovers of a run that died before compressing them */
+		if (path.size() < 3 || path.compare(path.size() - 3, 3, ".gz") != 0) {
+			if (compress(path)) {
+				path += ".gz";
+			}
+		}
+		m_rotated.push_back(path);
+	}
+}
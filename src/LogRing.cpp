@@ -0,0 +1,161 @@
+#include <vector>
+#include "Web.h"
+#include "LogRing.h"
+using namespace std;
+
+/* The data area starts on its own cache line */
+static constexpr size_t LOG_RING_HEADER_SIZE = 64;
+static_assert(sizeof(LogRingHeader) <= LOG_RING_HEADER_SIZE, "ring header does not fit");
+static_assert(sizeof(LogRecordHeader) == 16, "record header must keep records 8-byte aligned");
+
+static uint64_t alignRecord(uint64_t n)
+{
+	return (n + 7) & ~uint64_t(7);
+}
+
+LogRing::LogRing(): m_header(nullptr), m_data(nullptr), m_capacity(0), m_mapSize(0)
+{
+}
+
+LogRing::~LogRing()
+{
+	close();
+}
+
+bool LogRing::open(const char* path, size_t capacity)
+{
+	uint64_t cap = 4096;
+	while (cap < capacity) {
+		cap <<= 1;
+	}
+	size_t mapSize = LOG_RING_HEADER_SIZE + cap;
+
+	int fd = ::open(path, O_RDWR | O_CREAT, 0644);
+	if (fd == -1) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		::close(fd);
+		return false;
+	}
+	/* A ring of a different size is started over, otherwise the previous run's records are kept */
+	bool reuse = (size_t)st.st_size == mapSize;
+	if (!reuse && (ftruncate(fd, 0) == -1 || ftruncate(fd, mapSize) == -1)) {
+		::close(fd);
+		return false;
+	}
+	void* addr = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (addr == MAP_FAILED) {
+		return false;
+	}
+
+	LogRingHeader* header = (LogRingHeader*)addr;
+	if (!reuse || header->magic != LOG_RING_MAGIC || header->version != LOG_RING_VERSION
+		|| header->headerSize != LOG_RING_HEADER_SIZE || header->capacity != cap) {
+		memset(addr, 0, mapSize);
+		header->version = LOG_RING_VERSION;
+		header->headerSize = LOG_RING_HEADER_SIZE;
+		header->capacity = cap;
+		header->head.store(0);
+		header->magic = LOG_RING_MAGIC;
+	}
+
+	m_header = header;
+	m_data = (char*)addr + LOG_RING_HEADER_SIZE;
+	m_capacity = cap;
+	m_mapSize = mapSize;
+	return true;
+}
+
+void LogRing::close()
+{
+	if (m_header != nullptr) {
+		munmap(m_header, m_mapSize);
+		m_header = nullptr;
+		m_data = nullptr;
+	}
+}
+
+void LogRing::copyIn(uint64_t pos, const void* src, size_t n)
+{
+	size_t offset = pos & (m_capacity - 1);
+	size_t first = MIN(n, m_capacity - offset);
+	memcpy(m_data + offset, src, first);
+	if (first < n) {
+		memcpy(m_data, (const char*)src + first, n - first);
+	}
+}
+
+void LogRing::append(const char* data, size_t len)
+{
+	if (m_header == nullptr) {
+		return;
+	}
+	size_t maxLen = m_capacity / 4 - sizeof(LogRecordHeader);
+	if (len > maxLen) {
+		len = maxLen;
+	}
+	uint64_t total = alignRecord(sizeof(LogRecordHeader) + len);
+	uint64_t pos = m_header->head.fetch_add(total, memory_order_relaxed);
+
+	/* Write the header uncommitted first, so a crash halfway leaves a record the decoder skips */
+	LogRecordHeader rec;
+	rec.commit = 0;
+	rec.length = (uint32_t)len;
+	rec.position = pos;
+	copyIn(pos, &rec, sizeof(rec));
+	copyIn(pos + sizeof(rec), data, len);
+
+	/* Records are 8-byte aligned, so the commit word never straddles the end of the ring */
+	uint32_t* commit = (uint32_t*)(m_data + (pos & (m_capacity - 1)));
+	__atomic_store_n(commit, LOG_RECORD_COMMIT, __ATOMIC_RELEASE);
+}
+
+/* Copy n bytes out of a data area of size cap starting at absolute position pos */
+static void copyOut(const char* data, uint64_t cap, uint64_t pos, void* dst, size_t n)
+{
+	size_t offset = pos & (cap - 1);
+	size_t first = MIN(n, cap - offset);
+	memcpy(dst, data + offset, first);
+	if (first < n) {
+		memcpy((char*)dst + first, data, n - first);
+	}
+}
+
+size_t LogRing::decode(const char* image, size_t imageSize, RecordVisitor visitor, void* arg)
+{
+	if (imageSize < LOG_RING_HEADER_SIZE) {
+		return 0;
+	}
+	const LogRingHeader* header = (const LogRingHeader*)image;
+	uint64_t cap = header->capacity;
+	if (header->magic != LOG_RING_MAGIC || header->version != LOG_RING_VERSION
+		|| cap == 0 || (cap & (cap - 1)) != 0 || imageSize < header->headerSize + cap) {
+		return 0;
+	}
+	const char* data = image + header->headerSize;
+	uint64_t head = header->head.load();
+	uint64_t pos = head > cap ? head - cap : 0;
+	size_t count = 0;
+	vector<char> payload;
+
+	/* The oldest bytes may be the tail of an overwritten record, scan forward until a record's position matches */
+	while (pos + sizeof(LogRecordHeader) <= head) {
+		LogRecordHeader rec;
+		copyOut(data, cap, pos, &rec, sizeof(rec));
+		uint64_t total = alignRecord(sizeof(rec) + rec.length);
+		if (rec.commit != LOG_RECORD_COMMIT || rec.position != pos
+			|| rec.length > cap / 4 || pos + total > head) {
+			pos += 8;
+			continue;
+		}
+		payload.resize(rec.length);
+		copyOut(data, cap, pos + sizeof(rec), payload.data(), rec.length);
+		visitor(payload.data(), rec.length, arg);
+		count++;
+		pos += total;
+	}
+	return count;
+}
@@ -0,0 +1,225 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include "OpenFileCache.h"
+using namespace std;
+
+/* Changes that make a cached stat result or descriptor stale */
+static const uint32_t WATCH_EVENTS = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE
+									 | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+OpenFile::OpenFile(): error(0), fd(-1)
+{
+}
+
+OpenFile::~OpenFile()
+{
+	if (fd != -1) {
+		close(fd);
+	}
+}
+
+bool OpenFile::readAll(string& out) const
+{
+	if (fd == -1) {
+		return false;
+	}
+	out.resize(st.st_size);
+	size_t done = 0;
+	while (done < out.size()) {
+		ssize_t n = pread(fd, &out[done], out.size() - done, done);
+		if (n <= 0) {
+			return false;
+		}
+		done += n;
+	}
+	return true;
+}
+
+OpenFileCache* OpenFileCache::getInstance()
+{
+	static OpenFileCache instance;
+	return &instance;
+}
+
+OpenFileCache::OpenFileCache(): m_inotifyFd(-1), m_generation(0), m_hits(0), m_misses(0), m_invalidations(0)
+{
+}
+
+OpenFileCache::~OpenFileCache()
+{
+	if (m_inotifyFd != -1) {
+		close(m_inotifyFd);
+	}
+}
+
+bool OpenFileCache::init(const char* root)
+{
+	m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (m_inotifyFd == -1) {
+		return false;
+	}
+	watchTree(root);
+	if (m_watches.empty()) {
+		close(m_inotifyFd);
+		m_inotifyFd = -1;
+		return false;
+	}
+	return true;
+}
+
+void OpenFileCache::watchTree(const string& dir)
+{
+	int wd = inotify_add_watch(m_inotifyFd, dir.c_str(), WATCH_EVENTS | IN_ONLYDIR);
+	if (wd == -1) {
+		return;
+	}
+	m_watches[wd] = dir;
+	DIR* handle = opendir(dir.c_str());
+	if (handle == nullptr) {
+		return;
+	}
+	struct dirent* entry;
+	while ((entry = readdir(handle)) != nullptr) {
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+			continue;
+		}
+		/* Symbolic links are not followed, they could lead back up the tree */
+		string path = dir + "/" + entry->d_name;
+		struct stat st;
+		if (lstat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+			watchTree(path);
+		}
+	}
+	closedir(handle);
+}
+
+shared_ptr<OpenFile> OpenFileCache::load(const char* path)
+{
+	shared_ptr<OpenFile> file = make_shared<OpenFile>();
+	if (stat(path, &file->st) == -1) {
+		file->error = errno;
+		return file;
+	}
+	if (S_ISREG(file->st.st_mode) && (file->st.st_mode & S_IROTH)) {
+		file->fd = open(path, O_RDONLY | O_CLOEXEC);
+		/* The metadata of the file actually opened, it may have been replaced since the stat */
+		if (file->fd != -1) {
+			fstat(file->fd, &file->st);
+		}
+	}
+	return file;
+}
+
+shared_ptr<const OpenFile> OpenFileCache::lookup(const char* path)
+{
+	/* inotify reports the canonical path only, so other spellings of it are never cached */
+	if (m_inotifyFd == -1 || strstr(path, "//") != nullptr || strstr(path, "/./") != nullptr
+		|| strstr(path, "/../") != nullptr) {
+		return load(path);
+	}
+	string key(path);
+	time_t now = time(nullptr);
+
+	m_lock.lock();
+	auto it = m_index.find(key);
+	if (it != m_index.end()) {
+		if (it->second->expires > now) {
+			m_lru.splice(m_lru.begin(), m_lru, it->second);
+			m_hits++;
+			shared_ptr<const OpenFile> file = it->second->file;
+			m_lock.unlock();
+			return file;
+		}
+		m_lru.erase(it->second);
+		m_index.erase(it);
+	}
+	m_misses++;
+	size_t generation = m_generation;
+	m_lock.unlock();
+
+	shared_ptr<const OpenFile> file = load(path);
+
+	m_lock.lock();
+	if (generation == m_generation && m_index.find(key) == m_index.end()) {
+		Entry entry;
+		entry.path = key;
+		entry.expires = now + (file->error == 0 ? VALID_SECONDS : NEGATIVE_SECONDS);
+		entry.file = file;
+		m_lru.push_front(entry);
+		m_index[key] = m_lru.begin();
+		if (m_lru.size() > MAX_ENTRIES) {
+			m_index.erase(m_lru.back().path);
+			m_lru.pop_back();
+		}
+	}
+	m_lock.unlock();
+	return file;
+}
+
+void OpenFileCache::clear()
+{
+	m_lru.clear();
+	m_index.clear();
+}
+
+void OpenFileCache::handleEvents()
+{
+	/* Large enough for a burst of events, each name is at most NAME_MAX bytes */
+	char buf[16 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t len;
+	while ((len = read(m_inotifyFd, buf, sizeof(buf))) > 0) {
+		m_lock.lock();
+		m_generation++;
+		for (char* p = buf; p < buf + len; p += sizeof(struct inotify_event) + ((struct inotify_event*)p)->len) {
+			const struct inotify_event* event = (const struct inotify_event*)p;
+			m_invalidations++;
+			/* Events were lost, anything may have changed */
+			if (event->mask & IN_Q_OVERFLOW) {
+				clear();
+				continue;
+			}
+			if (event->mask & IN_IGNORED) {
+				m_watches.erase(event->wd);
+				continue;
+			}
+			auto watch = m_watches.find(event->wd);
+			if (watch == m_watches.end()) {
+				continue;
+			}
+			/* A directory appearing, moving or vanishing changes every path below it */
+			if ((event->mask & IN_ISDIR) || (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF))) {
+				clear();
+				if ((event->mask & (IN_CREATE | IN_MOVED_TO)) && event->len > 0) {
+					watchTree(watch->second + "/" + event->name);
+				}
+				continue;
+			}
+			/* The file named, and the directory whose mtime changed with it */
+			string paths[2] = { watch->second, event->len > 0 ? watch->second + "/" + event->name : string() };
+			for (int i = 0; i < 2; ++i) {
+				auto it = m_index.find(paths[i]);
+				if (it != m_index.end()) {
+					m_lru.erase(it->second);
+					m_index.erase(it);
+				}
+			}
+		}
+		m_lock.unlock();
+	}
+}
+
+OpenFileCacheStats OpenFileCache::stats()
+{
+	OpenFileCacheStats stats;
+	m_lock.lock();
+	stats.entries = m_lru.size();
+	stats.hits = m_hits;
+	stats.misses = m_misses;
+	stats.invalidations = m_invalidations;
+	m_lock.unlock();
+	return stats;
+}
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "ResponseHead.h"
+#include "MimeTypes.h"
+using namespace std;
+
+/* A status line with its length, formatted when compiled */
+struct StatusLine
+{
+	int status;
+	const char* line;
+	size_t len;
+};
+
+#define STATUS_LINE(status, reason) { status, "HTTP/1.1 " #status " " reason "\r\n", sizeof("HTTP/1.1 " #status " " reason "\r\n") - 1 }
+
+static constexpr StatusLine STATUS_LINES[] = {
+	STATUS_LINE(200, "OK"),
+	STATUS_LINE(304, "Not Modified"),
+	STATUS_LINE(400, "Bad Request"),
+	STATUS_LINE(403, "Forbidden"),
+	STATUS_LINE(404, "Not Found"),
+	STATUS_LINE(413, "Payload Too Large"),
+	STATUS_LINE(431, "Request Header Fields Too Large"),
+	STATUS_LINE(500, "Internal Error"),
+};
+
+/* Bodies of the error responses */
+static const struct
+{
+	int status;
+	const char* body;
+} ERROR_FORMS[] = {
+	{ 400, "ERROR_400: Your request has bad syntax or is inherently impossible to satisfy.\n" },
+	{ 403, "ERROR_403: You do not have permission to get file from this server.\n" },
+	{ 404, "ERROR_404: The requested file was not found on this server.\n" },
+	{ 413, "ERROR_413: The request body is larger than this server accepts.\n" },
+	{ 431, "ERROR_431: The request line and headers are larger than this server accepts.\n" },
+	{ 500, "ERROR_500: There was an unusual problem serving the requested file.\n" },
+};
+
+static constexpr size_t ERROR_NUM = sizeof(ERROR_FORMS) / sizeof(ERROR_FORMS[0]);
+
+/* "00" to "99" */
+static const char DIGIT_PAIRS[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+size_t ResponseHead::formatDecimal(char* out, unsigned long long value)
+{
+	/* Written backwards from the end of a scratch buffer, then moved into place */
+	char buf[MAX_DIGITS];
+	char* p = buf + MAX_DIGITS;
+	while (value >= 100) {
+		unsigned pair = (unsigned)(value % 100) * 2;
+		value /= 100;
+		p -= 2;
+		p[0] = DIGIT_PAIRS[pair];
+		p[1] = DIGIT_PAIRS[pair + 1];
+	}
+	if (value >= 10) {
+		p -= 2;
+		p[0] = DIGIT_PAIRS[value * 2];
+		p[1] = DIGIT_PAIRS[value * 2 + 1];
+	}
+	else {
+		*--p = (char)('0' + value);
+	}
+	size_t len = buf + MAX_DIGITS - p;
+	memcpy(out, p, len);
+	return len;
+}
+
+const char* ResponseHead::statusLine(int status, size_t& len)
+{
+	const StatusLine* found = &STATUS_LINES[sizeof(STATUS_LINES) / sizeof(STATUS_LINES[0]) - 1];
+	for (size_t i = 0; i < sizeof(STATUS_LINES) / sizeof(STATUS_LINES[0]); ++i) {
+		if (STATUS_LINES[i].status == status) {
+			found = &STATUS_LINES[i];
+			break;
+		}
+	}
+	len = found->len;
+	return found->line;
+}
+
+const char* ResponseHead::dateHeader(size_t& len)
+{
+	static const char* const DAYS[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+	static const char* const MONTHS[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+										  "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+	static thread_local time_t cachedSecond = -1;
+	static thread_local char header[48];
+	static thread_local size_t headerLen;
+	time_t now = time(nullptr);
+	if (now != cachedSecond) {
+		struct tm tm;
+		gmtime_r(&now, &tm);
+		headerLen = snprintf(header, sizeof(header), "Date: %s, %02d %s %d %02d:%02d:%02d GMT\r\n", DAYS[tm.tm_wday],
+							 tm.tm_mday, MONTHS[tm.tm_mon], tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+		cachedSecond = now;
+	}
+	len = headerLen;
+	return header;
+}
+
+const CannedResponse& ResponseHead::canned(int status)
+{
+	/* Built on first use, the table is constant afterwards */
+	struct Table
+	{
+		CannedResponse responses[ERROR_NUM];
+		Table()
+		{
+			for (size_t i = 0; i < ERROR_NUM; ++i) {
+				CannedResponse& response = responses[i];
+				response.status = ERROR_FORMS[i].status;
+				response.body = ERROR_FORMS[i].body;
+				response.bodyLen = strlen(response.body);
+				size_t len;
+				const char* line = statusLine(response.status, len);
+				response.head.assign(line, len);
+				response.head.append(MIME_TEXT.header, MIME_TEXT.headerLen);
+				char digits[MAX_DIGITS];
+				response.head += "Content-Length: ";
+				response.head.append(digits, formatDecimal(digits, response.bodyLen));
+				response.head += "\r\n";
+				response.tail = "\r\n";
+				response.tail.append(response.body, response.bodyLen);
+			}
+		}
+	};
+	static const Table table;
+	for (size_t i = 0; i < ERROR_NUM; ++i) {
+		if (table.responses[i].status == status) {
+			return table.responses[i];
+		}
+	}
+	return table.responses[ERROR_NUM - 1];
+}
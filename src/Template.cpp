@@ -0,0 +1,231 @@
+#include <dirent.h>
+#include <string.h>
+#include "Template.h"
+using namespace std;
+
+/* Strip the spaces around a tag name */
+static string trimName(const string& source, size_t start, size_t end)
+{
+	while (start < end && source[start] == ' ') {
+		start++;
+	}
+	while (end > start && source[end - 1] == ' ') {
+		end--;
+	}
+	return source.substr(start, end - start);
+}
+
+int Template::indexOf(const vector<string>& names, const string& name)
+{
+	for (size_t i = 0; i < names.size(); ++i) {
+		if (names[i] == name) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+int Template::addName(vector<string>& names, const string& name)
+{
+	int index = indexOf(names, name);
+	if (index != -1) {
+		return index;
+	}
+	if (names.size() == MAX_NAMES) {
+		return -1;
+	}
+	names.push_back(name);
+	return names.size() - 1;
+}
+
+bool Template::compile(const string& source, string& error)
+{
+	m_source = source;
+	m_ops.clear();
+	m_variables.clear();
+	m_loops.clear();
+	/* Index of the LOOP op of the loop being compiled, -1 outside loops */
+	int open = -1;
+	size_t pos = 0;
+	while (pos < m_source.size()) {
+		size_t tag = m_source.find("{{", pos);
+		size_t literalEnd = tag == string::npos ? m_source.size() : tag;
+		if (literalEnd > pos) {
+			m_ops.push_back(Op{ OP_LITERAL, false, pos, literalEnd - pos });
+		}
+		if (tag == string::npos) {
+			break;
+		}
+		bool raw = m_source.compare(tag, 3, "{{{") == 0;
+		const char* closer = raw ? "}}}" : "}}";
+		size_t nameStart = tag + strlen(closer);
+		size_t close = m_source.find(closer, nameStart);
+		if (close == string::npos) {
+			error = "unterminated tag at offset " + to_string(tag);
+			return false;
+		}
+		pos = close + strlen(closer);
+		string name = trimName(m_source, nameStart, close);
+		if (name.empty() || (raw && (name[0] == '#' || name[0] == '/'))) {
+			error = "bad tag at offset " + to_string(tag);
+			return false;
+		}
+
+		if (name[0] == '#') {
+			if (open != -1) {
+				error = "nested loop at offset " + to_string(tag);
+				return false;
+			}
+			string loopName = name.substr(1);
+			int index = -1;
+			for (size_t i = 0; i < m_loops.size(); ++i) {
+				if (m_loops[i].name == loopName) {
+					index = i;
+				}
+			}
+			if (index == -1) {
+				if (m_loops.size() == MAX_NAMES) {
+					error = "too many loops";
+					return false;
+				}
+				m_loops.push_back(Loop{ loopName, vector<string>() });
+				index = m_loops.size() - 1;
+			}
+			open = m_ops.size();
+			m_ops.push_back(Op{ OP_LOOP, false, (size_t)index, 0 });
+		}
+		else if (name[0] == '/') {
+			if (open == -1 || m_loops[m_ops[open].arg].name != name.substr(1)) {
+				error = "unmatched " + name + " at offset " + to_string(tag);
+				return false;
+			}
+			m_ops[open].extra = m_ops.size();
+			m_ops.push_back(Op{ OP_END, false, (size_t)open, 0 });
+			open = -1;
+		}
+		else {
+			/* Inside a loop every name is a column of its rows */
+			int index = open == -1 ? addName(m_variables, name) : addName(m_loops[m_ops[open].arg].columns, name);
+			if (index == -1) {
+				error = "too many names";
+				return false;
+			}
+			m_ops.push_back(Op{ open == -1 ? OP_VARIABLE : OP_COLUMN, !raw, (size_t)index, 0 });
+		}
+	}
+	if (open != -1) {
+		error = "unterminated loop " + m_loops[m_ops[open].arg].name;
+		return false;
+	}
+	return true;
+}
+
+int Template::variable(const char* name) const
+{
+	return indexOf(m_variables, name);
+}
+
+int Template::loop(const char* name) const
+{
+	for (size_t i = 0; i < m_loops.size(); ++i) {
+		if (m_loops[i].name == name) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+int Template::column(int loop, const char* name) const
+{
+	return loop < 0 ? -1 : indexOf(m_loops[loop].columns, name);
+}
+
+size_t Template::measure(const TemplateValue* vars, const TemplateRows* loops) const
+{
+	size_t len = 0;
+	auto count = [&len](const char*, size_t n) { len += n; };
+	render(vars, loops, count);
+	return len;
+}
+
+TemplateStore* TemplateStore::getInstance()
+{
+	static TemplateStore instance;
+	return &instance;
+}
+
+shared_ptr<const Template> TemplateStore::load(const OpenFile& file)
+{
+	string source;
+	string error;
+	shared_ptr<Template> compiled = make_shared<Template>();
+	if (!file.readAll(source) || !compiled->compile(source, error)) {
+		return nullptr;
+	}
+	return compiled;
+}
+
+int TemplateStore::init(const char* root)
+{
+	m_root = root;
+	DIR* handle = opendir(root);
+	if (handle == nullptr) {
+		return 0;
+	}
+	int compiled = 0;
+	struct dirent* entry;
+	while ((entry = readdir(handle)) != nullptr) {
+		size_t len = strlen(entry->d_name);
+		if (len <= 4 || strcmp(entry->d_name + len - 4, ".tpl") != 0) {
+			continue;
+		}
+		Entry tpl;
+		tpl.path = m_root + "/" + entry->d_name;
+		shared_ptr<const OpenFile> file = OpenFileCache::getInstance()->lookup(tpl.path.c_str());
+		tpl.ino = file->st.st_ino;
+		tpl.size = file->st.st_size;
+		tpl.mtime = file->st.st_mtim;
+		tpl.compiled = load(*file);
+		if (tpl.compiled) {
+			compiled++;
+		}
+		m_lock.lock();
+		m_templates[string(entry->d_name, len - 4)] = tpl;
+		m_lock.unlock();
+	}
+	closedir(handle);
+	return compiled;
+}
+
+shared_ptr<const Template> TemplateStore::get(const char* name)
+{
+	m_lock.lock();
+	auto it = m_templates.find(name);
+	if (it == m_templates.end()) {
+		m_lock.unlock();
+		return nullptr;
+	}
+	Entry tpl = it->second;
+	m_lock.unlock();
+
+	shared_ptr<const OpenFile> file = OpenFileCache::getInstance()->lookup(tpl.path.c_str());
+	if (file->fd == -1) {
+		return nullptr;
+	}
+	const struct stat& st = file->st;
+	if (st.st_ino == tpl.ino && st.st_size == tpl.size && st.st_mtim.tv_sec == tpl.mtime.tv_sec
+		&& st.st_mtim.tv_nsec == tpl.mtime.tv_nsec) {
+		return tpl.compiled;
+	}
+
+	/* Compile without the lock, the last thread to finish sets the entry */
+	shared_ptr<const Template> compiled = load(*file);
+	m_lock.lock();
+	Entry& current = m_templates[name];
+	current.ino = st.st_ino;
+	current.size = st.st_size;
+	current.mtime = st.st_mtim;
+	current.compiled = compiled;
+	m_lock.unlock();
+	return compiled;
+}
@@ -6,6 +6,7 @@ using namespace std;
 /* Static members of the class need to be initialized outside the class */
 int* Utils::u_pipefd = 0;
 int Utils::u_epollfd = 0;
+HttpConn* Utils::u_users = nullptr;
 
 Utils::Utils()
 {
@@ -81,10 +82,19 @@ void Utils::showError(int connfd, const char* info)
 	close(connfd);
 }
 
-void cbFunc(ClientData* userData)
+bool cbFunc(ClientData* userData)
 {
+	/* The file I/O pool still works on the connection and hands it back to the event loop, closing the socket
+	   now would let a new connection take the slot first; it is looked at again on the next tick */
+	if (Utils::u_users != nullptr && Utils::u_users[userData->sockfd].inFileIo()) {
+		userData->timer->expire = time(nullptr) + 1;
+		return false;
+	}
 	epoll_ctl(Utils::u_epollfd, EPOLL_CTL_DEL, userData->sockfd, nullptr);
 	assert(userData);
 	close(userData->sockfd);
+	/* The timer goes back to the pool right after this callback, so do not leave a dangling pointer */
+	userData->timer = nullptr;
 	HttpConn::m_userCount--;
+	return true;
 }
@@ -17,6 +17,8 @@ WebServer::WebServer()
 
     /* Initialize timers */
     m_usersTimer = new ClientData[MAX_FD];
+    m_ioPool = nullptr;
+    m_acceptPending = false;
 }
 
 WebServer::~WebServer()
@@ -29,11 +31,15 @@ WebServer::~WebServer()
     delete[] m_users;
     delete[] m_usersTimer;
     delete m_pool;
+    delete m_ioPool;
 }
 
 void WebServer::init(int port, string dbUser, string dbPwd, string dbName,
                      int logWrite, int optLinger, int triggerMode, int sqlNum,
-                     int threadNum, int closeLog, ActorModel model)
+                     int threadNum, int closeLog, ActorModel model, int logRing,
+                     int logKeep, int logSplitMB, int logSplitSeconds, int maxHeaderKB, int maxBodyKB,
+                     int maxRequests, int idleTimeout, int ioThreads, int compressCacheMB,
+                     string assetBundle, int writeThrough, int singleOwner, int inlineStatic)
 {
     m_port = port;
     m_dbUser = dbUser;
@@ -42,6 +48,20 @@ void WebServer::init(int port, string dbUser, string dbPwd, string dbName,
     m_sqlNum = sqlNum;
     m_threadNum = threadNum;
     m_logWrite = logWrite;
+    m_logRing = logRing;
+    m_logKeep = logKeep;
+    m_logSplitMB = logSplitMB;
+    m_logSplitSeconds = logSplitSeconds;
+    m_maxHeaderKB = maxHeaderKB;
+    m_maxBodyKB = maxBodyKB;
+    m_maxRequests = maxRequests;
+    m_idleTimeout = idleTimeout;
+    m_ioThreads = ioThreads;
+    m_compressCacheMB = compressCacheMB;
+    m_assetBundle = assetBundle;
+    m_writeThrough = writeThrough;
+    m_singleOwner = singleOwner;
+    m_inlineStatic = inlineStatic;
     m_optLinger = optLinger;
     m_triggerMode = triggerMode;
     m_closeLog = closeLog;
@@ -51,6 +71,22 @@ void WebServer::init(int port, string dbUser, string dbPwd, string dbName,
 void WebServer::threadPoolInit()
 {
     m_pool = new Threadpool<HttpConn>(m_actormodel, m_connPool, m_threadNum);
+    if (m_ioThreads > 0) {
+        m_ioPool = new FileIoPool<HttpConn>(m_ioThreads);
+    }
+}
+
+void WebServer::assetBundleInit()
+{
+    if (m_assetBundle.empty()) {
+        return;
+    }
+    if (!AssetStore::getInstance()->init(m_assetBundle.c_str(), m_root)) {
+        LOG_ERROR("asset bundle %s could not be loaded, errno is %d", m_assetBundle.c_str(), errno);
+        return;
+    }
+    shared_ptr<const AssetBundle> bundle = AssetStore::getInstance()->current();
+    LOG_INFO("asset bundle %s: %u files, %zu bytes", m_assetBundle.c_str(), bundle->count(), bundle->size());
 }
 
 void WebServer::connectionPoolInit()
@@ -66,10 +102,12 @@ void WebServer::logWriteInit()
 {
     if (m_closeLog == 0) {
         if (m_logWrite == 1) {
-            Log::getInstance()->init("./ServerLog", m_closeLog, 2000, 800000, 800);
+            Log::getInstance()->init("./ServerLog", m_closeLog, 2000, 800000, 800, m_logRing * 1024,
+                                     m_logSplitMB * 1024LL * 1024, m_logSplitSeconds, m_logKeep);
         }
         else {
-            Log::getInstance()->init("./ServerLog", m_closeLog, 2000, 800000, 0);
+            Log::getInstance()->init("./ServerLog", m_closeLog, 2000, 800000, 0, m_logRing * 1024,
+                                     m_logSplitMB * 1024LL * 1024, m_logSplitSeconds, m_logKeep);
         }
     }
 }
@@ -129,6 +167,8 @@ void WebServer::eventListen()
     assert(ret >= 0);
 
     m_utils.init(TIMESLOT);
+    /* Timers for every possible connection come from slabs allocated now, not from malloc per accept */
+    m_utils.m_timeHeap.reserve(MAX_FD);
 
     /* Create epoll kernel event table */
     m_epollfd = epoll_create(5);
@@ -136,6 +176,31 @@ void WebServer::eventListen()
     /* Register listening file descriptor to epoll kernel event table */
     m_utils.addfd(m_epollfd, m_listenfd, false, m_lfdMode);
     HttpConn::m_epollfd = m_epollfd;
+    HttpConn::m_maxHeaderSize = m_maxHeaderKB * 1024;
+    HttpConn::m_maxBodySize = m_maxBodyKB * 1024;
+    HttpConn::m_maxRequests = m_maxRequests;
+    HttpConn::m_idleTimeout = m_idleTimeout;
+    HttpConn::m_writeThrough = m_writeThrough != 0;
+    /* A level-triggered socket would keep reporting while its owner works on it, those stay EPOLLONESHOT */
+    HttpConn::m_singleOwner = m_singleOwner != 0 && m_cfdMode == EPOLL_ET;
+    /* Only the proactor loop does the I/O of connections itself */
+    HttpConn::m_inlineStatic = m_inlineStatic != 0 && m_actormodel == PROACTOR;
+    HttpConn::m_onLoop = true;
+    CompressCache::getInstance()->init((size_t)m_compressCacheMB * 1024 * 1024);
+    /* Changes under the root invalidate the open-file cache as they happen */
+    if (OpenFileCache::getInstance()->init(m_root)) {
+        m_utils.addfd(m_epollfd, OpenFileCache::getInstance()->inotifyFd(), false, EPOLL_LT);
+    }
+    else {
+        LOG_WARN("inotify on %s failed, errno is %d, the open-file cache is off", m_root, errno);
+    }
+    int templates = TemplateStore::getInstance()->init(m_root);
+    LOG_INFO("%d templates compiled", templates);
+    /* Finished filesystem tasks wake the loop like any other event */
+    if (m_ioPool != nullptr) {
+        m_utils.addfd(m_epollfd, m_ioPool->eventFd(), false, EPOLL_LT);
+        HttpConn::m_ioPool = m_ioPool;
+    }
 
     /* Create a pipe for notifying the timer and signal events (unified event source) */
     ret = socketpair(PF_UNIX, SOCK_STREAM, 0, m_pipefd);
@@ -149,6 +214,7 @@ void WebServer::eventListen()
 
     alarm(TIMESLOT);
     Utils::u_epollfd = m_epollfd;
+    Utils::u_users = m_users;
     Utils::u_pipefd = m_pipefd;
 }
 
@@ -156,24 +222,41 @@ void WebServer::eventLoop()
 {
     bool timeout = false;
     bool stopServer = false;
+    bool fileIoDone = false;
     while (!stopServer)
     {
-        int number = epoll_wait(m_epollfd, events, MAX_EVENT_NUMBER, -1);
+        /* Connections left on the listening socket raise no new edge, so the loop does not sleep on them */
+        int number = epoll_wait(m_epollfd, events, MAX_EVENT_NUMBER, m_acceptPending ? 0 : -1);
         if (number < 0 && errno != EINTR) {
             LOG_ERROR("%s", "epoll failure");
             break;
         }
+        /* The listening socket had its batch in this iteration */
+        bool accepted = false;
         for (int i = 0; i < number; ++i) {
             int sockfd = events[i].data.fd;
 
             /* Handle new client connections */
             if (sockfd == m_listenfd) {
+                accepted = true;
                 bool flag = dealClientData();
                 if (flag == false) {
                     LOG_ERROR("%s", "dealWithClientData failure");
                     continue;
                 }
             }
+            /* Finished filesystem tasks are handled after the batch */
+            else if (m_ioPool != nullptr && sockfd == m_ioPool->eventFd()) {
+                fileIoDone = true;
+            }
+            /* Handle changes under the document root */
+            else if (sockfd == OpenFileCache::getInstance()->inotifyFd()) {
+                OpenFileCache::getInstance()->handleEvents();
+            }
+            /* Events of a connection another thread holds are left to that owner */
+            else if (sockfd != m_pipefd[0] && (events[i].events = m_users[sockfd].claim(events[i].events)) == 0) {
+                continue;
+            }
             /* Handle exceptional events */
             else if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
                 /* Server closes the connection, remove the corresponding timer */
@@ -196,8 +279,40 @@ void WebServer::eventLoop()
                 dealWithWrite(sockfd);
             }
         }
+        /* A connection closed while its finished task is answered may still have an event in the batch,
+           so the tasks come after it */
+        if (fileIoDone) {
+            fileIoDone = false;
+            dealWithFileIo();
+        }
+        /* The next batch of queued connections, once every ready connection had its turn; not in an iteration
+           that already accepted one, so the budget holds while connections keep arriving */
+        if (m_acceptPending && !accepted) {
+            dealClientData();
+        }
         if (timeout) {
             m_utils.timerHandler();
+            PoolStats stats = m_utils.m_timeHeap.timerStats();
+            LOG_DEBUG("timer pool: %d in use, peak %d, capacity %d in %d slabs, %lld allocations",
+                      stats.inUse, stats.peak, stats.capacity, stats.slabs, stats.allocations);
+            BufferPoolStats bufStats = BufferPool::getInstance()->stats();
+            LOG_DEBUG("buffer pool: %d buffers (%zu bytes) in use, peak %zu bytes, %zu bytes allocated",
+                      bufStats.buffersInUse, bufStats.bytesInUse, bufStats.bytesPeak, bufStats.bytesTotal);
+            /* A bundle renamed over the served one goes into service, requests in flight finish on the old one */
+            if (AssetStore::getInstance()->refresh()) {
+                shared_ptr<const AssetBundle> bundle = AssetStore::getInstance()->current();
+                LOG_INFO("asset bundle %s swapped in: %u files, %zu bytes", m_assetBundle.c_str(),
+                         bundle->count(), bundle->size());
+            }
+            OpenFileCacheStats fileStats = OpenFileCache::getInstance()->stats();
+            LOG_DEBUG("open-file cache: %zu entries, %zu hits, %zu misses, %zu invalidations",
+                      fileStats.entries, fileStats.hits, fileStats.misses, fileStats.invalidations);
+            CompressCacheStats zipStats = CompressCache::getInstance()->stats();
+            LOG_DEBUG("compress cache: %zu variants, %zu bytes, %zu hits, %zu misses",
+                      zipStats.entries, zipStats.bytes, zipStats.hits, zipStats.misses);
+            ArenaStats arenaStats = Arena::stats();
+            LOG_DEBUG("request arenas: %zu requests, %zu allocations, %zu bytes, %zu extra blocks",
+                      arenaStats.requests, arenaStats.allocations, arenaStats.bytes, arenaStats.extraBlocks);
             timeout = false;
         }
     }
@@ -205,28 +320,30 @@ void WebServer::eventLoop()
 
 void WebServer::initTimer(int connfd, sockaddr_in clientAddress)
 {
-    m_users[connfd].init(connfd, clientAddress, m_root, m_cfdMode, m_closeLog, m_dbUser, m_dbPassword, m_dbName);
+    m_users[connfd].init(connfd, clientAddress, m_root, m_cfdMode, m_closeLog);
     /* Initialize clientData */
     /* Create a timer, set callback function and timeout, bind user data, and add the timer to the list */
     m_usersTimer[connfd].address = clientAddress;
     m_usersTimer[connfd].sockfd = connfd;
-    HeapTimer* timer = new HeapTimer(3 * TIMESLOT);
+    HeapTimer* timer = m_utils.m_timeHeap.createTimer(3 * TIMESLOT);
     timer->userData = &m_usersTimer[connfd];
     timer->cbFunc = cbFunc;
     m_usersTimer[connfd].timer = timer;
     m_utils.m_timeHeap.addTimer(timer);
 }
 
-void WebServer::adjustTimer(HeapTimer* timer)
+void WebServer::adjustTimer(HeapTimer* timer, bool idle)
 {
     time_t cur = time(nullptr);
-    timer->expire = cur + 3 * TIMESLOT;
+    timer->expire = cur + (idle ? m_idleTimeout : 3 * TIMESLOT);
     m_utils.m_timeHeap.adjustTimer(timer);
     LOG_INFO("%s", "adjust timer once");
 }
 
 void WebServer::dealTimer(HeapTimer* timer, int sockfd)
 {
+    /* No worker holds the connection here, so its buffers can go back to the pool right away */
+    m_users[sockfd].releaseBuffers();
     timer->cbFunc(&m_usersTimer[sockfd]);
     if (timer) {
         m_utils.m_timeHeap.delTimer(timer);
@@ -252,9 +369,15 @@ bool WebServer::dealClientData()
         }
         initTimer(connfd, clientAddress);
     }
-    /* Edge-triggered mode, accept all connections at once */
+    /* Edge-triggered mode, accept the queued connections up to the budget */
     else {
+        int accepted = 0;
+        m_acceptPending = false;
         while (true) {
+            if (accepted == ACCEPT_BUDGET) {
+                m_acceptPending = true;
+                break;
+            }
             int connfd = accept(m_listenfd, (struct sockaddr*)&clientAddress, &clientAddrlen);
             if (connfd < 0) {
                 if (errno != EWOULDBLOCK) {
@@ -268,6 +391,7 @@ bool WebServer::dealClientData()
                 break;
             }
             initTimer(connfd, clientAddress);
+            accepted++;
         }
         return false;
     }
@@ -304,9 +428,9 @@ void WebServer::dealWithRead(int sockfd)
     HeapTimer* timer = m_usersTimer[sockfd].timer;
     /* In the reactor model, the main thread only needs to accept new connections, and read/write operations are handled by the worker threads */
     if (m_actormodel == REACTOR) {
-        /* Update the timer's timeout */
+        /* Update the timer's timeout; a response written through by the worker leaves the connection waiting for its next request */
         if (timer) {
-            adjustTimer(timer);
+            adjustTimer(timer, m_writeThrough);
         }
         m_pool->append(m_users + sockfd, 0);
 
@@ -325,9 +449,17 @@ void WebServer::dealWithRead(int sockfd)
     else {
         if (m_users[sockfd].readn()) {
             LOG_INFO("deal with the client(%s)", inet_ntoa(m_users[sockfd].getAddress()->sin_addr));
-            m_pool->append_p(m_users + sockfd);
+            /* Static requests are answered right here, the thread pool gets the ones with handler logic */
+            if (!m_users[sockfd].processOnLoop()) {
+                m_pool->append_p(m_users + sockfd);
+            }
+            /* Closed while answered here, nothing is left to wait for its next event */
+            else if (m_users[sockfd].isClosing()) {
+                dealTimer(timer, sockfd);
+                return;
+            }
             if (timer) {
-                adjustTimer(timer);
+                adjustTimer(timer, m_writeThrough);
             }
         }
         else {
@@ -350,6 +482,10 @@ void WebServer::dealWithWrite(int sockfd)
                     dealTimer(timer, sockfd);
                     m_users[sockfd].m_timerFlag = 0;
                 }
+                /* Everything is answered, the connection now waits for its next request */
+                else if (timer && m_users[sockfd].isIdle()) {
+                    adjustTimer(timer, true);
+                }
                 m_users[sockfd].m_improv = 0;
                 break;
             }
@@ -358,8 +494,18 @@ void WebServer::dealWithWrite(int sockfd)
     else {
         if (m_users[sockfd].writen()) {
             LOG_INFO("send data to the client(%s)", inet_ntoa(m_users[sockfd].getAddress()->sin_addr));
+            /* Pipelined requests that arrived with the previous ones are already buffered, no EPOLLIN will report them */
+            if (m_users[sockfd].hasBufferedRequest()) {
+                if (!m_users[sockfd].processOnLoop()) {
+                    m_pool->append_p(m_users + sockfd);
+                }
+                else if (m_users[sockfd].isClosing()) {
+                    dealTimer(timer, sockfd);
+                    return;
+                }
+            }
             if (timer) {
-                adjustTimer(timer);
+                adjustTimer(timer, m_users[sockfd].isIdle());
             }
         }
         else {
@@ -368,6 +514,31 @@ void WebServer::dealWithWrite(int sockfd)
     }
 }
 
+void WebServer::dealWithFileIo()
+{
+    HttpConn* conns[64];
+    size_t count = m_ioPool->collect(conns, 64);
+    for (size_t i = 0; i < count; ++i) {
+        HttpConn* conn = conns[i];
+        conn->leaveFileIo();
+        /* The worker finishes the request with the result, nobody is waiting on it in the reactor model */
+        if (m_actormodel == REACTOR) {
+            m_pool->append(conn, 2);
+        }
+        else if (!conn->processOnLoop()) {
+            m_pool->append_p(conn);
+        }
+        else if (conn->isClosing()) {
+            dealTimer(m_usersTimer[conn - m_users].timer, conn - m_users);
+            continue;
+        }
+        HeapTimer* timer = m_usersTimer[conn - m_users].timer;
+        if (timer) {
+            adjustTimer(timer, m_writeThrough);
+        }
+    }
+}
+
 int WebServer::initDaemon()
 {
     /* Ignore terminal I/O signals and STOP signals */
@@ -20,7 +20,11 @@ int main(int argc, char* argv[])
     server.initDaemon();
 
     server.init(config.port, dbUser, dbPassword, dbName, config.logWrite, config.optLinger, config.triggerMode, 
-                config.sqlNum, config.threadNum, config.closeLog, config.model);
+                config.sqlNum, config.threadNum, config.closeLog, config.model, config.logRing,
+                config.logKeep, config.logSplitMB, config.logSplitSeconds, config.maxHeaderKB, config.maxBodyKB,
+                config.maxRequests, config.idleTimeout, config.ioThreads,
+                config.compressCacheMB, config.assetBundle, config.writeThrough,
+                config.singleOwner, config.inlineStatic);
 
     /* Log */
     server.logWriteInit();
@@ -31,6 +35,9 @@ int main(int argc, char* argv[])
     /* Thread pool */
     server.threadPoolInit();
 
+    /* Asset bundle */
+    server.assetBundleInit();
+
     /* Trigger mode */
     server.trigMode();
 
@@ -0,0 +1,25 @@
+#include <iostream>
+#include "Web.h"
+#include "AssetBundle.h"
+using namespace std;
+
+/* Pack a document root into an asset bundle, for a server started with -r to load or swap in */
+int main(int argc, char* argv[])
+{
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s root_dir bundle_file\n", argv[0]);
+		return 1;
+	}
+	int count = AssetBundle::pack(argv[1], argv[2]);
+	if (count < 0) {
+		fprintf(stderr, "packing %s into %s failed, errno is %d\n", argv[1], argv[2], errno);
+		return 1;
+	}
+	shared_ptr<AssetBundle> bundle = AssetBundle::load(argv[2], false);
+	if (!bundle) {
+		fprintf(stderr, "%s does not load back\n", argv[2]);
+		return 1;
+	}
+	fprintf(stderr, "%d files, %zu bytes\n", count, bundle->size());
+	return 0;
+}
@@ -0,0 +1,51 @@
+#include <iostream>
+#include "Web.h"
+#include "LogRing.h"
+using namespace std;
+
+/* Print one record, log lines already carry their own trailing newline */
+static void printRecord(const char* data, size_t len, void* arg)
+{
+	fwrite(data, 1, len, stdout);
+	if (len == 0 || data[len - 1] != '\n') {
+		fputc('\n', stdout);
+	}
+}
+
+/* Dump the records of a flight-recorder ring file, oldest first */
+int main(int argc, char* argv[])
+{
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s ServerLog.ring\n", argv[0]);
+		return 1;
+	}
+	int fd = open(argv[1], O_RDONLY);
+	if (fd == -1) {
+		fprintf(stderr, "open %s failed, errno is %d\n", argv[1], errno);
+		return 1;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == -1 || st.st_size == 0) {
+		fprintf(stderr, "%s is empty\n", argv[1]);
+		close(fd);
+		return 1;
+	}
+	void* image = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (image == MAP_FAILED) {
+		fprintf(stderr, "mmap %s failed, errno is %d\n", argv[1], errno);
+		return 1;
+	}
+
+	const LogRingHeader* header = (const LogRingHeader*)image;
+	if ((size_t)st.st_size < sizeof(LogRingHeader) || header->magic != LOG_RING_MAGIC) {
+		fprintf(stderr, "%s is not a log ring\n", argv[1]);
+		munmap(image, st.st_size);
+		return 1;
+	}
+	size_t count = LogRing::decode((const char*)image, st.st_size, printRecord, nullptr);
+	fprintf(stderr, "%zu records, %llu bytes written, ring capacity %llu\n", count,
+			(unsigned long long)header->head.load(), (unsigned long long)header->capacity);
+	munmap(image, st.st_size);
+	return 0;
+}